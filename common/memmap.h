@@ -0,0 +1,375 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Memory map of the Kodak Reels firmware, shared by hist and manwb.
+ *
+ * Every fixed address the hooks touch lives here.  Code only ever reaches
+ * them through MM(type, addr), which is a plain cast on the scanner and a
+ * lookup into a fake address space when built on a PC (-DREELS_HOST) or
+ * for user-mode qemu-mipsel (-DREELS_QEMU), so the same sources can be run
+ * and timed without flashing a unit.
+ *
+ * PHASE(name) marks the start of a section of a hook for the qemu
+ * instruction count breakdown; it emits no code.  CP0_COUNT(c) reads the
+ * CP0 Count register on the scanner, a clock from host_mem.c otherwise.
+ */
+
+#ifndef REELS_MEMMAP_H
+#define REELS_MEMMAP_H
+
+#include <stdint.h>
+
+#if defined(REELS_HOST)
+// KSEG0 (0x8xxxxxxx, cached) and KSEG1 (0xaxxxxxxx, uncached) alias the same
+// physical DRAM, so both fold onto one 128MB host buffer.
+#define KSEG_PHYS_MASK  0x1fffffff
+#define HOST_RAM_SIZE   0x08000000
+extern uint8_t *reels_host_ram;
+uint32_t reels_host_count(void);
+#define MM(type, addr)  ((type)(void *)(reels_host_ram + ((uint32_t)(addr) & KSEG_PHYS_MASK)))
+#define CUT_HERE()
+#define PHASE(name)
+#define CP0_COUNT(c)        ((c) = reels_host_count())
+#define KSEG0(type, p)      ((type)(p))
+#define CACHE_INV_LINE(p)
+#define REELS_HARNESS   1
+#elif defined(REELS_QEMU)
+// Same folding into a user-space window, still a compile time constant so
+// the MIPS code is the real -Os code with different lui immediates.
+#define KSEG_PHYS_MASK  0x1fffffff
+#define HOST_RAM_SIZE   0x08000000
+#define QEMU_RAM_BASE   0x40000000
+uint32_t reels_host_count(void);
+#define MM(type, addr)  ((type)((((uint32_t)(addr)) & KSEG_PHYS_MASK) | QEMU_RAM_BASE))
+#define CUT_HERE()
+#define PHASE(name)     asm volatile (".globl __phase_" #name "_%=\n__phase_" #name "_%=:" ::)
+#define CP0_COUNT(c)        ((c) = reels_host_count())  // mfc0 traps in user mode, the call isn't counted
+#define KSEG0(type, p)      ((type)(p))
+#define CACHE_INV_LINE(p)   asm volatile ("nop")  // cache is privileged in user mode, keep the count
+#define REELS_HARNESS   1
+#else
+#define MM(type, addr)  ((type)(addr))
+#define CUT_HERE()                                                  \
+	asm volatile (                                                  \
+		".word 0x202d2d2d\n" /*--- */                               \
+		".word 0x20545543\n" /*CUT */                               \
+		".word 0x45524548\n" /*HERE*/                               \
+		".word 0x2d2d2d20\n" /*--- */                               \
+	)
+#define PHASE(name)
+// CP0 Count, ticks at half the CPU clock
+#define CP0_COUNT(c)        asm volatile ("mfc0 %0, $9" : "=r"(c))
+// Cached alias of a KSEG1 pointer
+#define KSEG0(type, p)      ((type)((uint32_t)(p) & ~0x20000000))
+// Hit_Invalidate_D: drop the line holding p without writing it back
+#define CACHE_INV_LINE(p)   asm volatile ("cache 0x11, 0(%0)" :: "r"(p) : "memory")
+#endif
+
+#define DCACHE_LINE         32
+
+// Keeps the compiler from moving stores across it.  The hooks and anything
+// reading their scratch state share the one CPU, that is all the ordering
+// a single-producer ring needs.
+#define COMPILER_BARRIER()  asm volatile ("" ::: "memory")
+
+// Invalidate every D-cache line overlapping [start, end)
+#define CACHE_INV_RANGE(start, end)                                 \
+do{ uintptr_t _l = (uintptr_t)(start) & ~(uintptr_t)(DCACHE_LINE-1);\
+    for(; _l < (uintptr_t)(end); _l += DCACHE_LINE)                 \
+        CACHE_INV_LINE(_l);                                         \
+}while(0)
+
+
+// Firmware globals
+#define ADDR_REEL_TYPE      0x80340000  // 1, 2 or 3 (Type A, B, C hardware)
+#define ADDR_FRAMENO        0x80f8214c  // frame counter
+#define ADDR_FONT           0x8033A800  // 8x12 font ROM
+#define ADDR_TEXT_ENC       0x8033b500  // status text templates, 16 chars/line
+#define ADDR_TEXT_PREV      0x8033b600
+#define ADDR_LCD            0x81821180  // 8-bit palette LCD, all types
+#define ADDR_CURRENT_QP     0xa56f1f60  // uncached
+
+// Six frame NV12 rings (uncached aliases)
+#define ADDR_RING_PREVIEW   0xa2730b70
+#define ADDR_RING_ENCODE    0xa37AB770
+#define RING_FRAMES         6
+#define RING_STRIDE         0x97e00
+
+// Candidate buffers for the pre-rendered histogram overlay
+#define ADDR_OVERLAY0       0x86000000
+#define ADDR_OVERLAY1       0x86300000
+#define ADDR_OVERLAY2       0x86600000
+#define ADDR_OVERLAY3       0x86900000
+#define ADDR_OVERLAY4       0x86c00000
+#define OVERLAY_BYTES       0x4000  // at most what calc_histogram draws into one
+#define OVERLAY_REFRESH     64      // frames between full redraws of borders and bars
+
+// Our scratch area.  Only 0x85bf0000-0x85bf04ff is known to be free: the
+// baseline keeps its words and the histogram stats there, and the overlay
+// image it first put right after, at 0x85bf0500, corrupted the encoder.
+#define SCRATCH_EXPO_CHANGE 0x85bf0010
+#define SCRATCH_ENC_FRAMES  0x85bf0014
+#define SCRATCH_WB_GAINS    0x85bf0020  // r,g,b
+#define SCRATCH_BUTTON_READ 0x85bf002c  // flag to acknowledge the button press
+#define SCRATCH_WINDOW_RES  0x85bf0030  // w,h,x,y
+#define SCRATCH_PROFILE     0x85bf0040  // tag, frameno + count at the last calc_histogram, PROF_ENTRIES x 4 words
+#define SCRATCH_AWB         0x85bf00e0  // tag, r,g,b auto white balance gains from calc_histogram, 2 accumulators
+#define SCRATCH_HIST_STATS  0x85bf0100  // 4 x 128 uint16_t bins, Y R G B, up to 0x85bf0500
+
+// Everything bigger lives in two of the buffers the baseline also tried
+// for the overlay (the commented out 0x87600000-0x87e00000 set in
+// calc_histogram): it wrote a tag word and the 4 + 3 x 136 x 72 byte
+// image to each of them every frame, and that "doesn't hurt, doesn't
+// help", neither the encoder nor the display uses them.  So each is known
+// free for SCRATCH_WINDOW_SIZE bytes, and no further.  The firmware may
+// still clear them (a reel change, say), so all the state below is either
+// tagged or redrawn/rebuilt periodically.
+#define SCRATCH_WINDOW_A    0x87600000
+#define SCRATCH_WINDOW_B    0x87800000
+#define SCRATCH_WINDOW_SIZE 0x72c4
+#define SCRATCH_OVERLAY_PAL (SCRATCH_WINDOW_A + 0x0000) // tag + 64 x {y,u,v,0} int16_t overlay palette
+#define SCRATCH_OVERLAY_STATE (SCRATCH_WINDOW_A + 0x0300) // overlay buffer drawn last, frames since its full redraw + 3 x 128 bar heights
+#define SCRATCH_TEXT_CACHE  (SCRATCH_WINDOW_A + 0x0500) // frames since full draw + 16 x 32 uint16_t cells on the LCD
+#define SCRATCH_FRAME_BCD   (SCRATCH_WINDOW_A + 0x0b00) // tag, enc_frames value, the same in packed BCD
+#define SCRATCH_HIST_ACCUM  (SCRATCH_WINDOW_A + 0x0c00) // tag, total + 4 x 128 uint32_t decayed bins (Q8)
+#define SCRATCH_AE_STATE    (SCRATCH_WINDOW_A + 0x1440) // tag, correcting, settle frames, fast frames
+#define SCRATCH_CUT_STATE   (SCRATCH_WINDOW_A + 0x1480) // tag, last distance, 32 uint16_t luma bins of the last frame
+#define SCRATCH_RING_STATE  (SCRATCH_WINDOW_A + 0x14e0) // tag, ring base, frame being written, last completed frame
+#define SCRATCH_HIST_CDF    (SCRATCH_WINDOW_A + 0x1500) // 4 x 129 uint32_t cumulative bins Y R G B, 4 weighted sums
+#define SCRATCH_GATE        (SCRATCH_WINDOW_A + 0x1e00) // tag, frame, x1,x2,y1,y2 metering window, row/column projections
+#define SCRATCH_WEAVE       (SCRATCH_WINDOW_A + 0x2000) // 10 word header + 2 x (row + column) uint16_t luma projections
+#define SCRATCH_CALIB       (SCRATCH_WINDOW_A + 0x2540) // tag, frames, R,G,B sums of the film base levels being captured
+#define SCRATCH_TELEMETRY   (SCRATCH_WINDOW_A + 0x2600) // header + TLM_RECORDS x 32 byte per-frame records, see below
+#define SCRATCH_WEAVE_LOG   (SCRATCH_WINDOW_A + 0x4620) // TLM_RECORDS x 16 byte weave estimates, one per telemetry record
+#define SCRATCH_GLYPH_ATLAS (SCRATCH_WINDOW_B + 0x0000) // tag, checksum, 2 check words + 128 chars x 8 columns x 12 byte pre-rotated glyph masks
+
+// Film weave estimate calc_histogram publishes at SCRATCH_WEAVE, word
+// offsets: how far the picture moved since the previous frame.
+// WEAVE_PUB_FRAMENO reads 0 while it is being updated; a reader keeps a
+// copy only if it reads the same non-zero frame before and after.  This
+// is the latest frame only; every frame's estimate also goes to the weave
+// log, see below.
+#define WEAVE_TAG           0x57455632  // "WEV2", word 0
+#define WEAVE_PUB_DXDY      6   // int16_t dx (right) | dy (down) << 16, 1/16 pixels
+#define WEAVE_PUB_CONF      7   // x, y match confidence 0-255 in bits 0, 8 | WEAVE_PUB_OK
+#define WEAVE_PUB_FRAMENO   8   // frame counter of the frame the estimate is for
+#define WEAVE_PUB_OK        0x10000 // there is an estimate: same ring, a new frame
+
+// Per-frame telemetry, a single-producer ring written by calc_histogram.
+// Header words: tag, head (records ever written), tail (owned by whoever
+// drains the ring, never read by the producer).  Record n lives in slot
+// n % TLM_RECORDS; the producer never waits, a reader more than
+// TLM_RECORDS behind loses the oldest.  A record is valid when its seq
+// word reads n both before and after copying it: it is set to
+// TLM_SEQ_BUSY while the record is being filled.
+#define TLM_TAG             0x544c4d31  // "TLM1"
+#define TLM_HEADER          32
+#define TLM_RECORD          32
+#define TLM_RECORDS         256
+#define TLM_SEQ_BUSY        0xffffffff
+// Record fields, byte offsets, little endian
+#define TLM_SEQ             0   // uint32_t record number
+#define TLM_FRAMENO         4   // uint32_t firmware frame counter
+#define TLM_ENC_FRAMES      8   // uint32_t enc_frames, 0 in preview
+#define TLM_ISO             12  // uint16_t ISO the frame was taken at
+#define TLM_EXPO_TIME       14  // uint16_t exposure time the frame was taken at
+#define TLM_WB              16  // 3 x uint16_t WB gains r,g,b
+#define TLM_QP              22  // uint8_t current_Qp
+#define TLM_EV_BIAS         23  // int8_t EV bias setting
+#define TLM_Y_PCT           24  // 5 x uint8_t luma bin (0-127) at 1, 10, 50, 90, 99%
+#define TLM_Y_MEAN          29  // uint8_t mean luma, 0-255
+#define TLM_FLAGS           30  // uint8_t TLM_F_*
+#define TLM_SLOT            31  // uint8_t ring slot sampled
+#define TLM_F_ENCODE        0x01
+#define TLM_F_CORRECTING    0x02    // AE is correcting
+#define TLM_F_SETTLING      0x04    // AE is waiting for a jump to show up
+#define TLM_F_EXPO_CHANGED  0x08    // AE wrote a new ISO/exposure time this frame
+
+_Static_assert(SCRATCH_TELEMETRY + TLM_HEADER + TLM_RECORDS * TLM_RECORD == SCRATCH_WEAVE_LOG,
+               "the weave log must follow the telemetry ring");
+
+// Weave log, the weave estimate of every telemetry record, for an offline
+// stabiliser.  It follows the ring directly, so a dump of
+// TLM_HEADER + TLM_RECORDS * (TLM_RECORD + WEAVE_LOG_ENTRY) bytes from
+// SCRATCH_TELEMETRY holds both.  Entry n goes with record n, in slot
+// n % TLM_RECORDS, and has the record's seq protocol: its seq word reads
+// n before and after copying it, TLM_SEQ_BUSY while it is filled.  Only
+// written when calc_histogram is built with both TELEMETRY and WEAVE.
+#define WEAVE_LOG_ENTRY     16
+// Entry fields, byte offsets, little endian
+#define WEAVE_LOG_SEQ       0   // uint32_t telemetry record number
+#define WEAVE_LOG_FRAMENO   4   // uint32_t firmware frame counter
+#define WEAVE_LOG_DXDY      8   // WEAVE_PUB_DXDY
+#define WEAVE_LOG_CONF      12  // WEAVE_PUB_CONF
+
+_Static_assert(SCRATCH_WEAVE_LOG + TLM_RECORDS * WEAVE_LOG_ENTRY <=
+               SCRATCH_WINDOW_A + SCRATCH_WINDOW_SIZE, "weave log overruns SCRATCH_WINDOW_A");
+
+// CP0 Count profile of the hooks at SCRATCH_PROFILE.  One entry per phase
+// of calc_histogram, the whole of it and of select_wb, and the frame period
+// (calc_histogram to calc_histogram on consecutive frames).  Each entry is
+// the last value, min, max and a running average over ~2^PROF_AVG_SHIFT
+// frames, kept << PROF_AVG_SHIFT; all in Count ticks.  Clearing the tag
+// starts over.  PROFILE is the switch for both hooks, off by default
+// (make PROFILE=1): with it 0 neither reads CP0 Count or touches
+// SCRATCH_PROFILE.
+#ifndef PROFILE
+#define PROFILE             0
+#endif
+#define PROF_TAG            0x50524632  // "PRF2"
+#define PROF_HEADER         4   // words: tag, frameno, count, spare
+#define PROF_SAMPLE         0
+#define PROF_DRAW           1   // overlay borders and bars
+#define PROF_TEXT           2
+#define PROF_COMPOSITE      3
+#define PROF_AE             4
+#define PROF_WEAVE          5
+#define PROF_HIST           6   // calc_histogram up to the telemetry record
+#define PROF_WB             7   // select_wb
+#define PROF_PERIOD         8
+#define PROF_ENTRIES        9
+#define PROF_LAST           0   // words of an entry
+#define PROF_MIN            1
+#define PROF_MAX            2
+#define PROF_AVG            3
+#define PROF_AVG_SHIFT      4
+#define PROF_ENTRY(prof,e)  (&(prof)[PROF_HEADER + (e)*4])
+
+#define PROF_INIT(prof)                                             \
+do{ if((prof)[0] != PROF_TAG) {                                     \
+        for(int _e = 0; _e < PROF_ENTRIES; _e++) {                  \
+            uint32_t *_p = PROF_ENTRY(prof, _e);                    \
+            _p[PROF_LAST] = 0; _p[PROF_MIN] = 0xffffffff;           \
+            _p[PROF_MAX] = 0;  _p[PROF_AVG] = 0;                    \
+        }                                                           \
+        (prof)[1] = 0;                                              \
+        (prof)[0] = PROF_TAG;                                       \
+    }                                                               \
+}while(0)
+
+#define PROF_UPDATE(prof,e,ticks)                                   \
+do{ uint32_t *_p = PROF_ENTRY(prof, e), _t = (ticks);               \
+    _p[PROF_LAST] = _t;                                             \
+    if(_t < _p[PROF_MIN]) _p[PROF_MIN] = _t;                        \
+    if(_t > _p[PROF_MAX]) _p[PROF_MAX] = _t;                        \
+    _p[PROF_AVG] = _p[PROF_AVG] ? _p[PROF_AVG] - (_p[PROF_AVG] >> PROF_AVG_SHIFT) + _t \
+                                : _t << PROF_AVG_SHIFT;             \
+}while(0)
+
+// Per hardware type, the variant table.  Hooks pick their addresses with
+// REEL_ADDR(field, type): a runtime choice on the *ADDR_REEL_TYPE value by
+// default, or a constant when built for one type with -DREEL=A|B|C (make
+// REEL=A), which lets -Os fold them and drops the dispatch.
+#define REEL_A_ID               1
+#define REEL_A_NVM_BASE         0x80E0B78C  // exposure, sharpness, tint
+#define REEL_A_ACTIVE_SETTINGS  0x80DDC11C
+#define REEL_A_BUTTON           0xA0E8BFF8  // uncached
+#define REEL_A_EXPO_ISO         0x80e56134  // sensor ISO, exposure time follows
+
+#define REEL_B_ID               2
+#define REEL_B_NVM_BASE         0x80E0B87C
+#define REEL_B_ACTIVE_SETTINGS  0x80DDC204
+#define REEL_B_BUTTON           0xA0E8C0E8
+#define REEL_B_EXPO_ISO         0x80e56224
+
+#define REEL_C_ID               3
+#define REEL_C_NVM_BASE         0x80E0AD0C
+#define REEL_C_ACTIVE_SETTINGS  0x80DDB69C
+#define REEL_C_BUTTON           0xA0E8B578
+#define REEL_C_EXPO_ISO         0x80e556b4
+
+#define REEL_PASTE_(t, field)   REEL_##t##_##field
+#define REEL_PASTE(t, field)    REEL_PASTE_(t, field)
+#ifdef REEL
+#define REEL_TYPE()             REEL_PASTE(REEL, ID)
+#define REEL_ADDR(field, type)  REEL_PASTE(REEL, field)
+#else
+#define REEL_TYPE()             (*MM(volatile int *, ADDR_REEL_TYPE))
+#define REEL_ADDR(field, type)  ((type) == REEL_B_ID ? REEL_B_##field : \
+                                 (type) == REEL_C_ID ? REEL_C_##field : REEL_A_##field)
+#endif
+
+
+#define BUTTON_UP    0x1
+#define BUTTON_DOWN  0x2
+#define BUTTON_LEFT  0x4
+#define BUTTON_RIGHT 0x8
+#define BUTTON_BACK  0x20
+#define BUTTON_NEG   0x100
+#define BUTTON_PLUS  0x200
+#define BUTTON_OK    0x800
+
+// NVM slots, index into nvm_base[]
+#define NVM_WBAL        0
+#define NVM_SHARPEN     1
+#define NVM_SAT         2
+#define NVM_FREE        3
+#define NVM_DONOT_USE   4
+#define NVM_WB_MODS     5   // tint: r, b, g int8_t in bits 16, 8, 0
+#define NVM_EVBIAS      6
+#define NVM_FPS         7
+#define NVM_QPMIN       8
+#define NVM_ISOMAX      9
+#define NVM_EXPLOCK     10
+
+#define NVM_NAV         13
+#define NVM_ISO_LOCK    14
+#define NVM_SHUT_LOCK   15
+
+#define NVM_SAVE_WBAL    16
+#define NVM_SAVE_SHARPEN 17
+#define NVM_SAVE_SAT     18
+
+// Film base profile, captured by calc_histogram from the leader in
+// WB_MODE_CALIBRATE: the r and b gains (green 256) that make the base
+// neutral, and the level (0-255) the base then sits at, the black point
+// of the negative.
+#define NVM_PROFILE_GAINS 19  // r | b << 12
+#define NVM_PROFILE_BASE  20  // base level | NVM_PROFILE_TAG << 24
+#define NVM_PROFILE_TAG   0x50  // 'P'
+#define NVM_PROFILE_VALID(nvm)  ((uint32_t)(nvm)[NVM_PROFILE_BASE] >> 24 == NVM_PROFILE_TAG)
+
+// WB mode, bits 24-25 of nvm_base[NVM_WB_MODS]: the presets, auto (gains
+// from SCRATCH_AWB), the film base profile, or capturing that profile
+#define WB_MODS_MODE        0x03000000
+#define WB_MODS_MODE_SHIFT  24
+#define WB_MODE_PRESET      0
+#define WB_MODE_AUTO        1
+#define WB_MODE_PROFILE     2
+#define WB_MODE_CALIBRATE   3
+#define AWB_TAG         0x41574231 // "AWB1"
+
+// Auto WB and film base capture are off unless built with AWB=1 and
+// FILM_PROFILE=1 (make AWB=1 ...), for both hooks: calc_histogram does
+// the work, select_wb only offers the modes that are built in.
+#ifndef AWB
+#define AWB                 0
+#endif
+#ifndef FILM_PROFILE
+#define FILM_PROFILE        0
+#endif
+#define WB_MODE_BUILT(m)    ((m) == WB_MODE_PRESET || ((m) == WB_MODE_AUTO && AWB) || \
+                             ((m) >= WB_MODE_PROFILE && FILM_PROFILE))
+#define CALIB_TAG       0x43414c31 // "CAL1"
+
+#endif
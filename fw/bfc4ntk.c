@@ -0,0 +1,579 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * bfc4ntk [-t threads] [-x] -c in.rbn out.bcl
+ * bfc4ntk -d in.bcl out.rbn|-
+ *
+ * Linux stand-in for bfc4ntkVS.exe: packs a firmware image into a Novatek
+ * BCL1 container with the LZ77 coder of the Basic Compression Library
+ * (Marcus Geelnard), which is what the scanner's loader unpacks:
+ *
+ *   0x00  "BCL1"
+ *   0x04  uint16 checksum, left 0 (ntkcalc -cw fills it in)
+ *   0x06  uint16 algorithm, big endian, 9 = LZ77
+ *   0x08  uint32 unpacked size, big endian
+ *   0x0c  uint32 packed size, big endian, including the padding
+ *   0x10  LZ77 stream, zero padded to a multiple of 4
+ *
+ * BCL's LZ_Compress is a greedy parse that, at every position it stops at,
+ * takes the longest match at offsets 3..100000, the nearest one on a tie.
+ * That choice depends only on the position, so it is worked out for every
+ * position of a block on all cores, and the parse then walks the block on
+ * one thread, which keeps the output byte for byte what LZ_Compress writes.
+ * The search itself is exact but not brute force: matches are looked up on
+ * chains of equal 4-byte prefixes, runs of one byte value are compared in
+ * one step, and inside runs the candidates are worked out per run.  -x uses
+ * LZ_Compress's own exhaustive search instead, to check against.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define LZ_MAX_OFFSET   100000
+#define BCL_ALGO_LZ77   9
+#define BCL_HEADER      16
+#define BLOCK           (1u << 20)  // positions searched per parallel pass
+#define CHUNK           4096        // positions per work item
+#define NONE            0xffffffffu
+
+typedef struct { uint32_t start, len; } run_t;
+
+typedef struct {
+    const uint8_t *in;
+    uint32_t size;
+    uint32_t *run;      // bytes equal to in[i] from i on
+    uint32_t *prev;     // previous position with the same (not constant) 4 bytes
+    run_t *runs[256];   // maximal runs of >= 4 bytes, by byte value
+    uint32_t nruns[256];
+    int exhaustive;
+
+    // the block being searched
+    uint32_t base, end, next;
+    uint32_t *best_len, *best_off;
+} lz_t;
+
+static uint32_t key4(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+// Common prefix of in[x..] and in[y..], x < y, at most max; runs skip in one step
+static uint32_t common(const lz_t *lz, uint32_t x, uint32_t y, uint32_t max)
+{
+    const uint8_t *in = lz->in;
+    uint32_t n = 0;
+
+    while(n < max && in[x+n] == in[y+n])
+    {
+        uint32_t a = lz->run[x+n], b = lz->run[y+n];
+        if(a != b)
+        {
+            n += min_u32(a, b);
+            break;
+        }
+        n += a;
+    }
+    return min_u32(n, max);
+}
+
+// LZ_Compress's search at p: longest match, nearest offset on a tie, (3,0) if none over 3
+static void search_exhaustive(const lz_t *lz, uint32_t p, uint32_t *len, uint32_t *off)
+{
+    const uint8_t *p1 = &lz->in[p];
+    uint32_t left = lz->size - p, maxoffset = p > LZ_MAX_OFFSET ? LZ_MAX_OFFSET : p;
+    uint32_t bestlength = 3, bestoffset = 0, o;
+
+    for(o = 3; o <= maxoffset; o++)
+    {
+        const uint8_t *p2 = p1 - o;
+        if(p1[0] == p2[0] && (bestlength >= left || p1[bestlength] == p2[bestlength]))
+        {
+            uint32_t maxlength = left < o ? left : o, l = 0;
+            while(l < maxlength && p1[l] == p2[l]) l++;
+            if(l > bestlength)
+            {
+                bestlength = l;
+                bestoffset = o;
+            }
+        }
+    }
+    *len = bestlength;
+    *off = bestoffset;
+}
+
+static void consider(uint32_t l, uint32_t o, uint32_t *bl, uint32_t *bo)
+{
+    if(l > *bl || (l == *bl && l > 3 && o < *bo))
+    {
+        *bl = l;
+        *bo = o;
+    }
+}
+
+// Same result as search_exhaustive()
+static void search(const lz_t *lz, uint32_t p, uint32_t *len, uint32_t *off)
+{
+    uint32_t left = lz->size - p, lo = p > LZ_MAX_OFFSET ? p - LZ_MAX_OFFSET : 0;
+    uint32_t bl = 3, bo = 0, r, q;
+
+    *len = 3;
+    *off = 0;
+    if(left < 4 || p < 4)
+        return;
+
+    r = lz->run[p];
+    if(r < 4)
+    {
+        // matches of 4+ start with the same 4 bytes, nearest first
+        for(q = lz->prev[p]; q != NONE && q >= lo && bl < left; q = lz->prev[q])
+        {
+            uint32_t o = p - q, l;
+            if(o <= bl || lz->in[q+bl] != lz->in[p+bl])
+                continue;
+            l = common(lz, q, p, min_u32(left, o));
+            if(l > bl)
+            {
+                bl = l;
+                bo = o;
+            }
+        }
+    }
+    else
+    {
+        // p starts r >= 4 bytes of b (r <= left).  Candidates sit in runs of b:
+        // in this one, [s, e), any q matches exactly r; in an earlier run
+        // [s', e') a q with e'-q = rq bytes of b left matches rq if rq < r,
+        // r if rq > r, and r plus whatever follows both runs if rq == r.
+        uint8_t b = lz->in[p];
+        const run_t *runs = lz->runs[b];
+        uint32_t e = p + r, lim = lo, k, n = lz->nruns[b];
+        uint32_t kl = 0, kh = n;
+
+        while(kh - kl > 1)  // the run holding p
+        {
+            uint32_t m = (kl + kh) >> 1;
+            if(runs[m].start <= p) kl = m; else kh = m;
+        }
+        {
+            uint32_t s = runs[kl].start > lo ? runs[kl].start : lo;
+            uint32_t l = min_u32(r, p - s);
+            if(p - s >= 4 && l >= 4)
+                consider(l, l, &bl, &bo);
+        }
+        for(k = kl; k-- > 0; )
+        {
+            uint32_t s2 = runs[k].start, e2 = s2 + runs[k].len;
+            if(e2 < lim + 4)
+                break;
+            if(runs[k].len >= r && e2 - r >= lim)
+            {
+                uint32_t q2 = e2 - r, l = r;
+                if(e < lz->size)
+                    l += common(lz, e2, e, min_u32(left, p - q2) - r);
+                consider(min_u32(l, min_u32(left, p - q2)), p - q2, &bl, &bo);
+            }
+            else
+            {
+                uint32_t rq = min_u32(runs[k].len, e2 - lim);
+                if(rq >= 4)
+                    consider(rq, p - (e2 - rq), &bl, &bo);
+            }
+        }
+    }
+    *len = bl;
+    *off = bo;
+}
+
+static void *search_worker(void *arg)
+{
+    lz_t *lz = arg;
+
+    for(;;)
+    {
+        uint32_t p = __atomic_fetch_add(&lz->next, CHUNK, __ATOMIC_RELAXED), end;
+        if(p >= lz->end)
+            break;
+        end = p + CHUNK < lz->end ? p + CHUNK : lz->end;
+        for(; p < end; p++)
+        {
+            if(lz->exhaustive)
+                search_exhaustive(lz, p, &lz->best_len[p - lz->base], &lz->best_off[p - lz->base]);
+            else
+                search(lz, p, &lz->best_len[p - lz->base], &lz->best_off[p - lz->base]);
+        }
+    }
+    return NULL;
+}
+
+static int lz_index(lz_t *lz)
+{
+    const uint8_t *in = lz->in;
+    uint32_t n = lz->size, i, c, *pos, *tmp;
+    static uint32_t count[65536];
+    int pass;
+
+    lz->run = malloc(sizeof(uint32_t) * (n + 1));
+    lz->prev = malloc(sizeof(uint32_t) * (n + 1));
+    if(!lz->run || !lz->prev)
+        return -1;
+
+    for(i = n; i-- > 0; )
+        lz->run[i] = (i + 1 < n && in[i+1] == in[i]) ? lz->run[i+1] + 1 : 1;
+
+    for(i = 0; i < n; )
+    {
+        uint32_t len = lz->run[i];
+        if(len >= 4)
+        {
+            run_t **r = &lz->runs[in[i]];
+            if((lz->nruns[in[i]] & (lz->nruns[in[i]] - 1)) == 0)
+            {
+                *r = realloc(*r, sizeof(run_t) * (lz->nruns[in[i]] ? lz->nruns[in[i]] * 2 : 16));
+                if(!*r)
+                    return -1;
+            }
+            (*r)[lz->nruns[in[i]]].start = i;
+            (*r)[lz->nruns[in[i]]++].len = len;
+        }
+        i += len;
+    }
+
+    // Chains of equal 4 byte prefixes: stable radix sort of the positions by
+    // prefix, then each position links to the one before it in its group.
+    for(i = 0; i < n; i++)
+        lz->prev[i] = NONE;
+    if(n < 4)
+        return 0;
+    pos = malloc(sizeof(uint32_t) * (n - 3));
+    tmp = malloc(sizeof(uint32_t) * (n - 3));
+    if(!pos || !tmp)
+        return -1;
+    for(i = 0; i < n - 3; i++)
+        pos[i] = i;
+    for(pass = 0; pass < 2; pass++)
+    {
+        uint32_t sum = 0, *src = pass ? tmp : pos, *dst = pass ? pos : tmp;
+        memset(count, 0, sizeof(count));
+        for(i = 0; i < n - 3; i++)
+            count[(key4(&in[src[i]]) >> (16 * pass)) & 0xffff]++;
+        for(c = 0; c < 65536; c++)
+        {
+            uint32_t t = count[c];
+            count[c] = sum;
+            sum += t;
+        }
+        for(i = 0; i < n - 3; i++)
+            dst[count[(key4(&in[src[i]]) >> (16 * pass)) & 0xffff]++] = src[i];
+    }
+    for(i = 1; i < n - 3; i++)
+        if(key4(&in[pos[i]]) == key4(&in[pos[i-1]]) && lz->run[pos[i]] < 4)
+            lz->prev[pos[i]] = pos[i-1];
+    free(pos);
+    free(tmp);
+    return 0;
+}
+
+static uint32_t write_var(uint32_t x, uint8_t *buf)
+{
+    uint32_t y = x >> 3;
+    int num_bytes, i;
+
+    for(num_bytes = 5; num_bytes >= 2; --num_bytes)
+    {
+        if(y & 0xfe000000)
+            break;
+        y <<= 7;
+    }
+    for(i = num_bytes - 1; i >= 0; --i)
+        *buf++ = (uint8_t)(((x >> (i * 7)) & 0x7f) | (i > 0 ? 0x80 : 0));
+    return num_bytes;
+}
+
+static uint32_t read_var(const uint8_t *buf, uint32_t *x)
+{
+    uint32_t y = 0, n = 0, b;
+
+    do
+    {
+        b = buf[n++];
+        y = (y << 7) | (b & 0x7f);
+    } while(b & 0x80);
+    *x = y;
+    return n;
+}
+
+// LZ_Compress, out needs size * 257 / 256 + 1 bytes
+static uint32_t lz_compress(lz_t *lz, uint8_t *out, int threads)
+{
+    const uint8_t *in = lz->in;
+    uint32_t insize = lz->size, inpos = 0, outpos = 1, histogram[256] = {0}, i;
+    uint8_t marker = 0;
+    pthread_t *tid;
+
+    if(insize < 1)
+        return 0;
+    tid = malloc(sizeof(pthread_t) * threads);
+    for(i = 0; i < insize; i++)
+        histogram[in[i]]++;
+    for(i = 1; i < 256; i++)
+        if(histogram[i] < histogram[marker])
+            marker = i;
+    out[0] = marker;
+
+    lz->best_len = malloc(sizeof(uint32_t) * BLOCK);
+    lz->best_off = malloc(sizeof(uint32_t) * BLOCK);
+
+    do
+    {
+        uint32_t bestlength, bestoffset;
+
+        if(inpos == 0 || inpos >= lz->end)
+        {
+            int t;
+            lz->base = lz->next = inpos;
+            lz->end = insize - inpos > BLOCK ? inpos + BLOCK : insize;
+            for(t = 0; t < threads; t++)
+                pthread_create(&tid[t], NULL, search_worker, lz);
+            for(t = 0; t < threads; t++)
+                pthread_join(tid[t], NULL);
+        }
+        bestlength = lz->best_len[inpos - lz->base];
+        bestoffset = lz->best_off[inpos - lz->base];
+
+        if((bestlength >= 8) ||
+           ((bestlength == 4) && (bestoffset <= 0x0000007f)) ||
+           ((bestlength == 5) && (bestoffset <= 0x00003fff)) ||
+           ((bestlength == 6) && (bestoffset <= 0x001fffff)) ||
+           ((bestlength == 7) && (bestoffset <= 0x0fffffff)))
+        {
+            out[outpos++] = marker;
+            outpos += write_var(bestlength, &out[outpos]);
+            outpos += write_var(bestoffset, &out[outpos]);
+            inpos += bestlength;
+        }
+        else
+        {
+            uint8_t symbol = in[inpos++];
+            out[outpos++] = symbol;
+            if(symbol == marker)
+                out[outpos++] = 0;
+        }
+    } while(insize - inpos > 3);
+
+    for(; inpos < insize; inpos++)
+    {
+        out[outpos++] = in[inpos];
+        if(in[inpos] == marker)
+            out[outpos++] = 0;
+    }
+
+    free(lz->best_len);
+    free(lz->best_off);
+    free(tid);
+    return outpos;
+}
+
+// LZ_Uncompress, stopping at outsize where the padding starts; returns the
+// unpacked size or 0 on a malformed stream
+static uint32_t lz_uncompress(const uint8_t *in, uint8_t *out, uint32_t insize, uint32_t outsize)
+{
+    uint32_t inpos = 1, outpos = 0;
+    uint8_t marker;
+
+    if(insize < 1)
+        return 0;
+    marker = in[0];
+    while(inpos < insize && outpos < outsize)
+    {
+        uint8_t symbol = in[inpos++];
+        if(symbol != marker)
+        {
+            if(outpos >= outsize)
+                return 0;
+            out[outpos++] = symbol;
+        }
+        else if(in[inpos] == 0)
+        {
+            if(outpos >= outsize)
+                return 0;
+            out[outpos++] = marker;
+            inpos++;
+        }
+        else
+        {
+            uint32_t length, offset, i;
+            inpos += read_var(&in[inpos], &length);
+            inpos += read_var(&in[inpos], &offset);
+            if(offset > outpos || length > outsize - outpos)
+                return 0;
+            for(i = 0; i < length; i++, outpos++)
+                out[outpos] = out[outpos - offset];
+        }
+    }
+    return outpos;
+}
+
+static uint8_t *load(const char *path, uint32_t *size)
+{
+    FILE *fp = fopen(path, "rb");
+    uint8_t *buf;
+    long n;
+
+    if(!fp)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = malloc(n + 1);
+    if(!buf || fread(buf, 1, n, fp) != (size_t)n)
+    {
+        fclose(fp);
+        free(buf);
+        return NULL;
+    }
+    fclose(fp);
+    *size = (uint32_t)n;
+    return buf;
+}
+
+// "-" writes to stdout, for bfc4ntk -d out.bcl - | cmp - in.rbn
+static int save(const char *path, const uint8_t *buf, uint32_t size)
+{
+    FILE *fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    int ok = fp && fwrite(buf, 1, size, fp) == size;
+
+    if(fp && fclose(fp) != 0)
+        ok = 0;
+    return ok ? 0 : -1;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: bfc4ntk [-t threads] [-x] -c in.rbn out.bcl\n"
+                    "       bfc4ntk -d in.bcl out.rbn|-\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN), exhaustive = 0, mode = 0, opt;
+    uint32_t size, packed;
+    uint8_t *in, *out;
+
+    while((opt = getopt(argc, argv, "cdt:x")) != -1)
+    {
+        switch(opt)
+        {
+        case 'c': case 'd': mode = opt; break;
+        case 't': threads = atoi(optarg); break;
+        case 'x': exhaustive = 1; break;
+        default: usage();
+        }
+    }
+    if(!mode || argc - optind != 2)
+        usage();
+    if(threads < 1)
+        threads = 1;
+
+    in = load(argv[optind], &size);
+    if(!in)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    if(mode == 'c')
+    {
+        lz_t lz;
+
+        memset(&lz, 0, sizeof(lz));
+        lz.in = in;
+        lz.size = size;
+        lz.exhaustive = exhaustive;
+        out = calloc(1, BCL_HEADER + (size_t)size * 257 / 256 + 8);
+        if(!out || lz_index(&lz) < 0)
+        {
+            fprintf(stderr, "bfc4ntk: out of memory\n");
+            return 1;
+        }
+        packed = (lz_compress(&lz, out + BCL_HEADER, threads) + 3) & ~3u;
+        memcpy(out, "BCL1", 4);
+        out[6] = 0;
+        out[7] = BCL_ALGO_LZ77;
+        put_be32(out + 8, size);
+        put_be32(out + 12, packed);
+        packed += BCL_HEADER;
+        printf("%s: %u -> %u bytes (%.1f%%)\n", argv[optind + 1], size, packed,
+               size ? 100.0 * packed / size : 0.0);
+    }
+    else
+    {
+        uint32_t unpacked;
+
+        if(size < BCL_HEADER || memcmp(in, "BCL1", 4) != 0 ||
+           (in[6] << 8 | in[7]) != BCL_ALGO_LZ77 || get_be32(in + 12) > size - BCL_HEADER)
+        {
+            fprintf(stderr, "bfc4ntk: %s is not an LZ77 BCL1 image\n", argv[optind]);
+            return 1;
+        }
+        unpacked = get_be32(in + 8);
+        out = malloc(unpacked + 1);
+        if(!out)
+        {
+            fprintf(stderr, "bfc4ntk: out of memory\n");
+            return 1;
+        }
+        packed = lz_uncompress(in + BCL_HEADER, out, get_be32(in + 12), unpacked);
+        if(packed != unpacked)
+        {
+            fprintf(stderr, "bfc4ntk: %s: corrupt LZ77 stream\n", argv[optind]);
+            return 1;
+        }
+    }
+
+    if(save(argv[optind + 1], out, packed) < 0)
+    {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    return 0;
+}
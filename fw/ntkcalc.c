@@ -0,0 +1,156 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * ntkcalc -c[w] image [baseval]
+ * ntkcalc -m[w] image baseval offset
+ * ntkcalc -b image
+ *
+ * Linux stand-in for ntkcalcVS.exe.  The Novatek loader accepts an image
+ * when the 16-bit sum of its little-endian halfwords, each plus its index,
+ * comes to baseval (0 unless given); the halfword at the checksum offset
+ * only counts its index.  The offset follows from the image:
+ *
+ *   "BCL1" at 0          compressed image (FullComp), checksum at 0x04
+ *   0xaa55 at 0x6c       raw Ntk image (NonComp/PartComp), checksum at 0x6e
+ *   0xffff at 0x6c       raw eCos image, checksum at 0x46e
+ *
+ * or is given with -m.  -c prints the checksum and how far the stored one is
+ * off, -cw/-mw writes it, -b prints the baseval the stored one was made for.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ntkcalc -c[w] image [baseval]\n"
+                    "       ntkcalc -m[w] image baseval offset\n"
+                    "       ntkcalc -b image\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *mode = argc > 1 ? argv[1] : "";
+    int write = 0, manual = 0, base_only = 0;
+    uint32_t offset = 0, size, i, words;
+    uint16_t baseval = 0, sum = 0, checksum, stored;
+    uint8_t *buf;
+    FILE *fp;
+    long n;
+
+    if(!strcmp(mode, "-c") || !strcmp(mode, "-cw"))
+    {
+        if(argc != 3 && argc != 4)
+            usage();
+        if(argc == 4)
+            baseval = (uint16_t)strtoul(argv[3], NULL, 16);
+    }
+    else if(!strcmp(mode, "-m") || !strcmp(mode, "-mw"))
+    {
+        if(argc != 5)
+            usage();
+        manual = 1;
+        baseval = (uint16_t)strtoul(argv[3], NULL, 16);
+        offset = (uint32_t)strtoul(argv[4], NULL, 16);
+    }
+    else if(!strcmp(mode, "-b") && argc == 3)
+        base_only = 1;
+    else
+        usage();
+    write = mode[2] == 'w';
+
+    fp = fopen(argv[2], write ? "r+b" : "rb");
+    if(!fp)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = malloc(n + 1);
+    if(!buf || fread(buf, 1, n, fp) != (size_t)n)
+    {
+        fprintf(stderr, "ntkcalc: can't read %s\n", argv[2]);
+        return 1;
+    }
+    size = (uint32_t)n;
+
+    if(!manual)
+    {
+        if(size >= 4 && !memcmp(buf, "BCL1", 4))
+            offset = 0x04;
+        else if(size >= 0x70 && get_le16(buf + 0x6c) == 0xaa55)
+            offset = 0x6e;
+        else if(size >= 0x470 && get_le16(buf + 0x6c) == 0xffff)
+            offset = 0x46e;
+        else
+        {
+            fprintf(stderr, "ntkcalc: %s: no BCL1 header or checksum magic at 0x6c, use -m\n", argv[2]);
+            return 1;
+        }
+    }
+    if((offset & 1) || offset + 2 > size)
+    {
+        fprintf(stderr, "ntkcalc: checksum offset 0x%x is outside %s\n", offset, argv[2]);
+        return 1;
+    }
+
+    words = size >> 1;
+    for(i = 0; i < words; i++)
+        sum += (uint16_t)((i << 1 == offset ? 0 : get_le16(buf + (i << 1))) + i);
+    checksum = baseval - sum;
+    stored = get_le16(buf + offset);
+
+    if(base_only)
+        printf("%s: baseval %04x\n", argv[2], (uint16_t)(stored + sum));
+    else if(!write)
+        printf("%s: checksum %04x at 0x%x, stored %04x%s\n", argv[2], checksum, offset, stored,
+               stored == checksum ? "" : " (wrong)");
+    else
+    {
+        uint8_t le[2] = { checksum & 0xff, checksum >> 8 };
+        if(fseek(fp, offset, SEEK_SET) != 0 || fwrite(le, 1, 2, fp) != 2)
+        {
+            fprintf(stderr, "ntkcalc: can't write %s\n", argv[2]);
+            return 1;
+        }
+        printf("%s: checksum %04x written at 0x%x\n", argv[2], checksum, offset);
+    }
+    if(fclose(fp) != 0)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    free(buf);
+    return 0;
+}
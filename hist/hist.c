@@ -20,37 +20,8 @@
  * SOFTWARE.
  */
  
- #include <stdint.h>
-
-#define BUTTON_UP    0x1
-#define BUTTON_DOWN  0x2
-#define BUTTON_LEFT  0x4
-#define BUTTON_RIGHT 0x8
-#define BUTTON_BACK  0x20
-#define BUTTON_NEG   0x100
-#define BUTTON_PLUS  0x200
-#define BUTTON_OK    0x800
-
-#define NVM_WBAL        0
-#define NVM_SHARPEN     1
-#define NVM_SAT         2
-#define NVM_FREE        3
-#define NVM_DONOT_USE   4
-#define NVM_WB_MODS     5
-#define NVM_EVBIAS      6
-#define NVM_FPS         7
-#define NVM_QPMIN       8
-#define NVM_ISOMAX      9
-#define NVM_EXPLOCK     10
-
-#define NVM_NAV         13
-
-#define NVM_ISO_LOCK    14
-#define NVM_SHUT_LOCK   15
-
-#define NVM_SAVE_WBAL    16
-#define NVM_SAVE_SHARPEN 17
-#define NVM_SAVE_SAT     18
+#include <stdint.h>
+#include "memmap.h"
 
 #define WIDTH 656
 #define PITCH 656
@@ -62,6 +33,23 @@
 #define HIST_WIDTH (128+8)
 #define HIST_PITCH (HIST_WIDTH+TEXT_WIDTH)
 #define HIST_HEIGHT (64+8)
+
+// The overlay is three packed planes (R, G, B) of 2-bit codes, 4 pixels per
+// byte with the leftmost pixel in the low bits.  Codes stand for the only
+// three levels the overlay uses.
+#define OVL_STRIDE  (HIST_PITCH/4)
+#define OVL_PLANE   (OVL_STRIDE*HIST_HEIGHT)
+_Static_assert(3*OVL_PLANE <= OVERLAY_BYTES, "overlay larger than OVERLAY_BYTES");
+#define OVL_BG      0   // 1
+#define OVL_EDGE    1   // 63
+#define OVL_BAR     2   // 127
+#define OVL_LEVEL(code)  ((code) == OVL_BG ? 1 : (code) == OVL_EDGE ? 63 : 127)
+#define OVL_PAL_TAG 0x50414c31 // "PAL1"
+#define OVL_SET(plane,x,y,code)                                              \
+do{ uint8_t *_b = &(plane)[(y)*OVL_STRIDE + ((x)>>2)]; int _s = ((x)&3)*2;   \
+    *_b = (*_b & ~(3<<_s)) | ((code)<<_s);                                   \
+}while(0)
+
 #define HEIGHT 480
 #define NUM_BINS 128
 #define EDGE 48
@@ -153,8 +141,71 @@ enum Palette {
 
 #define DRAW        1
 
-#define FONT_BASE_ADDR   ((uintptr_t)0x8033A800u)
-#define FONT7x12_ROM     ((const uint8_t (*)[12])FONT_BASE_ADDR)
+// Sample the frame through the cached KSEG0 alias after invalidating just the
+// sampled lines, rather than one uncached DRAM round trip per byte.
+#define CACHED_SAMPLING 1
+
+// Append a TLM_RECORD per frame to the telemetry ring at SCRATCH_TELEMETRY
+// (layout in memmap.h), for a reader to drain into a sidecar file, and with
+// WEAVE the frame's weave estimate to the weave log next to it.
+#define TELEMETRY   1
+
+// PROFILE (memmap.h, shared with select_wb, make PROFILE=1) times the phases
+// with CP0 Count into SCRATCH_PROFILE, and PROFILE_OVERLAY shows the hook's
+// share of the frame period on the status text's "WB gains:" line.
+#define PROFILE_OVERLAY 0
+#if PROFILE
+// Count ticks since the last mark go to the phase that is ending
+#define PROF_MARK(ph)                                                              \
+do{ uint32_t _c; CP0_COUNT(_c);                                                    \
+    prof_acc[prof_ph] += _c - prof_last;                                           \
+    prof_last = _c; prof_ph = (ph);                                                \
+}while(0)
+#else
+#define PROF_MARK(ph)
+#endif
+
+// Sample every 8th pixel on a grid whose offset rotates through 16 phases,
+// (0,0),(4,0),(0,4),(4,4),(2,0)... so four frames cover the old every 4th
+// pixel grid and sixteen every 2nd pixel, for a quarter of the reads.  The
+// bins are accumulated into a decayed histogram that keeps the old scale.
+#define SPARSE_SAMPLING 1
+
+// The features below are off by default to keep the hook small enough for
+// its stub (make stub-check); turn them on with make GATE_DETECT=1 WEAVE=1
+// AWB=1 FILM_PROFILE=1.
+
+// Meter only inside the film gate found from row and column luma
+// projections, instead of the fixed EDGE, EDGE_X1 and EDGE_X2 margins.
+#ifndef GATE_DETECT
+#define GATE_DETECT 0
+#endif
+
+// Estimate the film weave, how far the picture moved since the last frame,
+// from row and column luma projections, for SCRATCH_WEAVE and the weave log.
+#ifndef WEAVE
+#define WEAVE       0
+#endif
+
+// AWB (memmap.h) estimates white balance gains from the R, G and B
+// histograms into SCRATCH_AWB, for select_wb to use when auto WB is on
+// (WB_MODE_AUTO).  FILM_PROFILE (memmap.h) captures a film base profile
+// (NVM_PROFILE_*) from the leader when the WB mode is WB_MODE_CALIBRATE.
+
+#if SPARSE_SAMPLING
+#define SAMPLE_STEP 8
+#define HIST_DECAY  2   // keep 3/4 of the history each frame, 4 x one frame's counts
+#define HIST_FRAC   8   // fraction bits of the accumulator
+#define HIST_ACC_TAG 0x41434331 // "ACC1"
+#define SAMPLE_DX(ph)   ((((ph)&1)<<2) | (((ph)>>1)&2))
+#define SAMPLE_DY(ph)   ((((ph)&2)<<1) | (((ph)>>2)&2))
+#else
+#define SAMPLE_STEP 4
+#define SAMPLE_DX(ph)   0
+#define SAMPLE_DY(ph)   0
+#endif
+
+#define FONT7x12_ROM     MM(const uint8_t (*)[12], ADDR_FONT)
 
 #define FW  8
 #define FH  12
@@ -199,10 +250,14 @@ do{ int _X=(x),_Y=(y);                                                        \
 /* 7x11 font, MSB=leftmost (use bits 6..0). Undefined chars render blank. */
 /* Draw one glyph at (x,y); v = intensity 0..255. MSB=leftmost */
 #define DRAW_GLYPH_V(buf,stride,w,h,x,y,ch,v)                                        \
+        DRAW_GLYPH_V_COLS(buf,stride,w,h,x,y,ch,v,FW)
+
+/* Only the first cols columns of the glyph */
+#define DRAW_GLYPH_V_COLS(buf,stride,w,h,x,y,ch,v,cols)                              \
 do{ unsigned char _c=(unsigned char)(ch); int _r,_c0;                              \
     for(_r=0;_r<FH;++_r){                                                          \
         uint8_t _bits=FONT7x12_ROM[_c][_r];                                        \
-        for(_c0=0;_c0<FW;++_c0) {                                                  \
+        for(_c0=0;_c0<(cols);++_c0) {                                              \
           _P_V((buf),(stride),(w),(h),(x)+_c0,(y)+_r,(_bits&(1u<<((FW-1)-_c0))?v:7));\
         }                                                                          \
     }                                                                              \
@@ -217,6 +272,78 @@ if(buf[0] == 7) { const char*_p=(const char*)(str); int _cx=(x), _cy=(y), _cv=(v
     }\
 }
 
+/* Pre-rotated glyph atlas, built once from FONT7x12_ROM.  A glyph column is
+   an LCD row, so each of its FH pixels is stored contiguously as it sits in
+   LCD memory, as a 0xff (ink) / 0x00 mask.  Drawing a glyph column is then
+   ATLAS_WORDS 32-bit (unaligned) stores instead of FH strided byte writes.
+   Other users of the scratch window could overwrite it, so ATLAS_SLICE words
+   of it are summed per frame and a pass that does not match the checksum
+   taken when it was built rebuilds it. */
+#define ATLAS_CHARS  128
+#define ATLAS_WORDS  (FH/4)
+#define ATLAS_TAG    0x41544c32 // "ATL2"
+#define ATLAS_HEADER 4          // words: tag, checksum, next word to sum, sum so far
+#define ATLAS_SIZE   (ATLAS_CHARS*FW*ATLAS_WORDS)  // words
+#define ATLAS_SLICE  64         // a full pass every ATLAS_SIZE/ATLAS_SLICE frames
+#define ATLAS_SUM(s,w)  ((((s) << 1) | ((s) >> 31)) + (w))
+_Static_assert((ATLAS_HEADER + ATLAS_SIZE)*4 <= SCRATCH_WINDOW_SIZE, "glyph atlas overruns its window");
+
+typedef struct { uint32_t u32; } __attribute__((packed)) lcd_word;
+
+#define BUILD_GLYPH_ATLAS(atlas)                                                   \
+do{ uint8_t *_a=(uint8_t *)(atlas); int _c,_c0,_r;                                 \
+    for(_c=0;_c<ATLAS_CHARS;++_c)                                                  \
+        for(_c0=0;_c0<FW;++_c0)                                                    \
+            for(_r=0;_r<FH;++_r)                                                   \
+                *_a++ = (FONT7x12_ROM[_c][_r]&(1u<<((FW-1)-_c0))) ? 0xff : 0;      \
+}while(0)
+
+/* First cols columns of a glyph from the atlas, colour v on black (7) */
+#define DRAW_GLYPH_ATLAS(buf,stride,w,h,x,y,ch,v,cols,atlas)                       \
+do{ if((unsigned char)(ch) >= ATLAS_CHARS)                                         \
+        DRAW_GLYPH_V_COLS(buf,stride,w,h,x,y,ch,v,cols);                           \
+    else {                                                                         \
+        const uint32_t *_g=&(atlas)[(unsigned char)(ch)*FW*ATLAS_WORDS];           \
+        uint32_t _fg=(uint8_t)(v)*0x01010101u, _bg=7*0x01010101u; int _c0,_k;      \
+        for(_c0=0;_c0<(cols);++_c0,_g+=ATLAS_WORDS){                               \
+            int _X=(x)+_c0;                                                        \
+            lcd_word *_d=(lcd_word *)&(buf)[_I_V((h),(stride),_X,(y))];            \
+            for(_k=0;_k<ATLAS_WORDS;++_k)                                          \
+                _d[_k].u32=(_g[_k]&_fg)|(~_g[_k]&_bg);                             \
+        }                                                                          \
+    }                                                                              \
+}while(0)
+
+/* Same as DRAW_TEXT_V, but only redraws the character cells whose glyph or
+   colour differ from what cache[] says is on screen.  cache[0] counts frames
+   since the last full draw and is zeroed while the firmware owns the LCD
+   (buf[0] != 7), so the first frame back redraws everything.
+   Glyphs are FW wide on an FW-1 advance: the next cell owns the overlapping
+   column, so a cell only draws it when it ends the line (part of its key). */
+#define TEXT_ROWS    16
+#define TEXT_COLS    32
+#define TEXT_REFRESH 64  // full redraw every N frames regardless
+#define DRAW_TEXT_V_CACHED(buf,stride,w,h,x,y,str,v,cache,atlas)                    \
+do{ if(buf[0] == 7) {                                                              \
+    const char*_p=(const char*)(str); int _cx=(x), _cy=(y), _cv=(v);               \
+    int _row=0, _col=0, _full=(cache)[0] == 0 || (cache)[0] >= TEXT_REFRESH;       \
+    uint16_t *_cell = (uint16_t *)&(cache)[1];                                     \
+    (cache)[0] = _full ? 1 : (cache)[0] + 1;                                       \
+    for(;*_p;++_p){ int _last = _p[1] == 0 || _p[1] == 10;                         \
+        uint16_t _key = (uint8_t)*_p | ((_cv & 0x7f)<<8) | (_last<<15);            \
+        if(_row >= TEXT_ROWS || _col >= TEXT_COLS)                                 \
+            DRAW_GLYPH_ATLAS((buf),(stride),(w),(h),_cx,_cy,*_p,_cv,FW,(atlas));   \
+        else if(_full || _cell[_row*TEXT_COLS+_col] != _key) {                     \
+            _cell[_row*TEXT_COLS+_col] = _key;                                     \
+            DRAW_GLYPH_ATLAS((buf),(stride),(w),(h),_cx,_cy,*_p,_cv,_last ? FW : FW-1,(atlas));\
+        }                                                                          \
+        _cx+=FW-1; _col++;                                                         \
+        if(_p[1] == 10) { ++_p; _cy+=FH+1; _cx=(x); _row++; _col=0; }              \
+        else if(_p[1]>0x0 && _p[1]<0x20) _cv = _p[1];                              \
+    }                                                                              \
+  } else (cache)[0] = 0;                                                           \
+}while(0)
+
 #define DRAW_TEXT_V_ALWAYS(buf,stride,w,h,x,y,str,v)                                      \
 { const char*_p=(const char*)(str); int _cx=(x), _cy=(y);                               \
   for(;*_p;++_p){ DRAW_GLYPH_V((buf),(stride),(w),(h),_cx,(y),*_p,(v)); _cx+=FW-1; } }
@@ -240,29 +367,311 @@ do {                                            \
     (res) = __res;                              \
 } while(0)
 
+// n/10 for any 32-bit n from the high word of a multu, no trip through the divider
+#define DIV10(n)    ((uint32_t)(((uint64_t)(uint32_t)(n) * 0xCCCCCCCDu) >> 35))
+
+/* Status text number formatting.  Fields are written in place into the
+   16 chars per line text templates, right aligned, the low width digits.
+   pad replaces leading zeros (never the last digit), 0 keeps them. */
+#define FMT_PAD(dst,width,pad)                                                     \
+do{ if(pad) { int _i;                                                              \
+        for(_i=0;_i<(width)-1 && (dst)[_i]=='0';_i++) (dst)[_i]=(pad); }           \
+}while(0)
+
+#define FMT_DEC(dst,n,width,pad)                                                   \
+do{ char *_d=(dst); uint32_t _n=(n), _q; int _i;                                   \
+    for(_i=(width)-1;_i>=0;_i--) { _q=DIV10(_n); _d[_i]='0'+(_n-_q*10); _n=_q; }   \
+    FMT_PAD(_d,(width),(pad));                                                     \
+}while(0)
+
+/* Left aligned at dst[pos], at least min digits, pos moves past it */
+#define FMT_DEC_LEFT(dst,pos,n,min)                                                \
+do{ uint32_t _v=(n), _t=DIV10(_v); int _w=1;                                       \
+    for(;_t;_t=DIV10(_t)) _w++;                                                    \
+    if(_w<(min)) _w=(min);                                                         \
+    FMT_DEC(&(dst)[pos],_v,_w,0); (pos)+=_w;                                       \
+}while(0)
+
+/* Packed BCD, one digit per nibble */
+#define FMT_BCD(dst,bcd,width,pad)                                                 \
+do{ char *_d=(dst); uint32_t _b=(bcd); int _i;                                     \
+    for(_i=(width)-1;_i>=0;_i--,_b>>=4) _d[_i]='0'+(_b&0xf);                       \
+    FMT_PAD(_d,(width),(pad));                                                     \
+}while(0)
+
+#define BCD_INC(bcd)                                                               \
+do{ int _s;                                                                        \
+    for(_s=0;_s<32;_s+=4) {                                                        \
+        if((((bcd)>>_s)&0xf) < 9) { (bcd)+=1u<<_s; break; }                       \
+        (bcd)&=~(0xfu<<_s);                                                        \
+    }                                                                              \
+}while(0)
+
+#define BCD_FROM(bcd,n)                                                            \
+do{ uint32_t _n=(n), _q; int _s;                                                   \
+    (bcd)=0;                                                                       \
+    for(_s=0;_n && _s<32;_s+=4) { _q=DIV10(_n); (bcd)|=(_n-_q*10)<<_s; _n=_q; }    \
+}while(0)
+#define BCD_TAG     0x42434431 // "BCD1"
+
+/* The numeric fields of each status text: row, column, width, value, pad.
+   Expanded with a TEXT_FIELD() of the caller's choosing, so adding a field
+   is one line and there is no table in memory to splice along. */
+#define TEXT_FIELDS_WB(F)                                                          \
+    F(2, 1, 3, wb_gains[0], 0)                                                     \
+    F(2, 5, 3, wb_gains[1], 0)                                                     \
+    F(2, 9, 3, wb_gains[2], 0)
+
+#define TEXT_FIELDS_EXPO(F)                                                        \
+    F(6, 5, 2, DIV10(expo_iso[0]), ' ')  /* " 5" for ISO 50, "40" for 400 */        \
+    F(7, 4, 4, expo_time[0], 0)
+
+#define TEXT_FIELDS_ENC(F)                                                         \
+    TEXT_FIELDS_WB(F)                                                              \
+    F(5, 5, 2, current_Qp[0], 0)                                                   \
+    F(5, 8, 2, nvm_base[NVM_QPMIN]-1, 0)                                           \
+    TEXT_FIELDS_EXPO(F)
+
+#define TEXT_FIELDS_PREV(F)                                                        \
+    TEXT_FIELDS_WB(F)                                                              \
+    TEXT_FIELDS_EXPO(F)
+
+#define TEXT_FIELD(row,col,width,n,pad)   FMT_DEC(&text[(row)*16+(col)],(n),(width),(pad));
+
+/* Cumulative histograms, one pass per frame over the Y, R, G and B bins.
+   cdf[b] is the number of samples in bins [0,b), so any range count is one
+   subtraction; the percentile is a 7 probe binary search over the 129
+   entries.  HIST_WSUM(cdf) is the sum of bin*count, for the mean. */
+#define CDF_LEN             (NUM_BINS+1)
+#define HIST_CDF(cdf,ch)    (&(cdf)[(ch)*CDF_LEN])
+#define HIST_WSUM(cdf,ch)   ((cdf)[4*CDF_LEN+(ch)])
+#define HIST_TOTAL(c)       ((c)[NUM_BINS])
+#define HIST_COUNT(c,lo,hi) ((c)[hi]-(c)[lo])
+
+#define BUILD_HIST_CDF(cdf,stats)                                                  \
+do{ int _ch,_b;                                                                    \
+    for(_ch=0;_ch<4;_ch++) {                                                       \
+        uint32_t *_c=HIST_CDF((cdf),_ch), _s=0, _w=0;                              \
+        const uint16_t *_h=&(stats)[_ch*NUM_BINS];                                 \
+        for(_b=0;_b<NUM_BINS;_b++) { _c[_b]=_s; _s+=_h[_b]; _w+=_h[_b]*_b; }       \
+        _c[NUM_BINS]=_s; HIST_WSUM((cdf),_ch)=_w;                                  \
+    }                                                                              \
+}while(0)
+
+/* Highest bin b with more than n samples in [b,NUM_BINS), 0 if there is none */
+#define HIST_TOP_PCT(c,n,res)                                                      \
+do{ uint32_t _n=(n); int _lo=0,_hi=NUM_BINS-1;                                     \
+    if(HIST_TOTAL(c) > _n) {                                                       \
+        uint32_t _lim=HIST_TOTAL(c)-_n;                                            \
+        while(_lo<_hi) { int _m=(_lo+_hi+1)>>1; if((c)[_m]<_lim) _lo=_m; else _hi=_m-1; }\
+    }                                                                              \
+    (res)=_lo;                                                                     \
+}while(0)
+
+/* Fixed point log2 in 1/256 stops (x > 0), and v scaled by 2^(s/256).  The
+   fraction uses log2(1+f) ~ f + 0.34f(1-f) and 2^f ~ 1 + f - 0.34f(1-f),
+   within 0.01 stop, so no libm and no table. */
+#define LOG2_Q8(x, res)                                                            \
+do{ uint32_t _x=(x); int _e=31-__builtin_clz(_x);                                  \
+    uint32_t _f=(_e>=8 ? _x>>(_e-8) : _x<<(8-_e)) & 0xff;                          \
+    (res) = (_e<<8) + _f + ((_f*(256-_f)*87)>>16);                                 \
+}while(0)
+
+#define EXP2_SCALE_Q8(v, s, res)                                                   \
+do{ int _s=(s), _i=_s>>8; uint32_t _f=_s&0xff;                                     \
+    uint32_t _r=((uint32_t)(v)*(256+_f-((_f*(256-_f)*87)>>16)))>>8;               \
+    (res) = _i>=0 ? _r<<_i : _r>>-_i;                                              \
+}while(0)
+
+/* Predictive AE: put the luma level that only AE_PCT_SHIFT of the sampled
+   pixels exceed (~0.8%) on AE_TARGET_LUMA.  The error is in 1/256 stops of
+   exposure (output luma ~ exposure^(1/2.2) near the top, AE_GAMMA_Q8), most
+   of it is applied at once, then it fine-tunes in smaller steps.  Hysteresis:
+   a correction starts past AE_WAKE and runs until the error is inside AE_HOLD.
+   While correcting AE meters each frame on its own (the decayed history
+   would lag the change), and after a jump it waits AE_SETTLE frames for
+   the sensor to catch up.
+   A scene cut (see CUT_*) puts AE straight into correcting, on a fresh
+   history, taking the whole error per frame for AE_FAST_FRAMES. */
+#define AE_PCT_SHIFT    7       // total>>7
+#define AE_TARGET_LUMA  216
+#define AE_GAMMA_Q8     563     // 2.2
+#define AE_WAKE         48      // 0.19 stop
+#define AE_HOLD         12      // 0.05 stop
+#define AE_FINE         128     // below half a stop, take half the error per frame
+#define AE_MAX_STEP     512     // 2 stops per frame
+#define AE_CLIP_STEP    256     // at least a stop down while the percentile is clipped
+#define AE_CLIP_BIN     120     // luma 240, where the ISP clips (sky ends up at 240-242)
+#define AE_SETTLE       2       // frames
+#define AE_FAST_FRAMES  8
+#define AE_STATE_TAG    0x41455331 // "AES1"
+
+/* Auto white balance, white patch: the level only the top 1/2^AWB_PCT_SHIFT
+   of the samples exceed in each of R, G and B should be equal, or their
+   means (gray world) when one of them is clipped.  The histograms are of
+   the picture after the gains that were applied (wb_gains, tint included),
+   so those are divided out to get the film's own colour, in linear light
+   (AWB_GAMMA_Q8), and the red and blue gains that neutralise it, green
+   staying at 256, are approached by 1/2^AWB_RATE per frame.  Too dark a
+   frame doesn't move them. */
+#define AWB_PCT_SHIFT   5       // total>>5, ~3%
+#define AWB_CLIP_BIN    120     // level 240
+#define AWB_DARK_BIN    16      // level 32
+#define AWB_GAMMA_Q8    AE_GAMMA_Q8
+#define AWB_MAX_STEP    512     // at most 2 stops of correction from one frame
+#define AWB_RATE        4
+#define AWB_MIN         128     // gains 0.5x to ~3.9x
+#define AWB_MAX         999     // the status text shows 3 digits
+
+/* Gain for a channel at level l, taken with gain gc, that puts it on the
+   level lg green has under gain gg, green staying at 256.  l and lg in any
+   one scale. */
+#define WB_NEUTRAL_GAIN(gc, gg, l, lg, res)                                        \
+do{ int _wl,_wg,_ws;                                                               \
+    LOG2_Q8((l),_wl); LOG2_Q8((lg),_wg);                                           \
+    _ws=((_wg-_wl)*AWB_GAMMA_Q8)>>8;                                               \
+    if(_ws>AWB_MAX_STEP) _ws=AWB_MAX_STEP;                                         \
+    if(_ws<-AWB_MAX_STEP) _ws=-AWB_MAX_STEP;                                       \
+    EXP2_SCALE_Q8(((gc)<<8)/(gg),_ws,(res));                                       \
+    if((res)<AWB_MIN) (res)=AWB_MIN;                                               \
+    if((res)>AWB_MAX) (res)=AWB_MAX;                                               \
+}while(0)
+
+/* Film base profile: an unexposed leader is nothing but the base (the
+   orange mask of a negative), so the gains that make its mean R, G and B
+   equal correct the stock, and its level is the black point.  Frames
+   whose green spans more than CALIB_FLAT_BINS between the 10% and 90%
+   points aren't leader and are passed over; the first CALIB_SKIP leader
+   frames let the decayed history settle, then the means of the next
+   CALIB_FRAMES are averaged.  A base too dark (reversal leader) or
+   clipped leaves no profile and drops back to the presets. */
+#define CALIB_FLAT_BINS 8       // 16 levels
+#define CALIB_SKIP      4
+#define CALIB_FRAMES_SHIFT 5    // 32 frames
+
+/* Scene cut (splice, reel change): the luma bins of this frame alone, folded
+   into CUT_BINS, moved by more than total>>CUT_SHIFT (L1) from the last
+   frame's.  Only checked while AE is holding, as its own corrections move
+   the histogram too. */
+#define CUT_BINS        32
+#define CUT_SHIFT       1       // half the samples' worth of L1, a quarter changed bins
+#define CUT_TAG         0x43555431 // "CUT1"
+
+/* Frame ring: completed frames carry a stamp in their first pixels until
+   the ISP starts on them again (see the tracker in calc_histogram).  The
+   stamp is per slot, and its bytes are below video black, so the corner
+   of a stamped frame that does get encoded stays black. */
+#define RING_TAG        0x52494e33 // "RIN3"
+#define RING_STAMP(s)   (0x0a000500 | (s))  // first pixels s, 5, 0, 10
+
+/* Film gate.  The frame is cut into GATE_CELL pixel cells; each frame reads
+   the centre pixel of every cell on one in GATE_BANDS cell rows, so a full
+   set of row and column means takes GATE_BANDS frames, and every
+   GATE_REFRESH frames the lowest and highest mean each row and column had
+   decide where the picture is.  Gate mask and film margin never light up
+   (max < GATE_DARK), sprocket holes and clear base never drop from white
+   (min > GATE_CLEAR), and anything that mixes the two, like a line through a
+   sprocket hole, hardly changes (max - min < GATE_STILL), while the picture
+   does.  From each side the first GATE_RUN picture cells in a row start the
+   window, GATE_INSET inside it.  A window smaller than half the frame, as
+   from a static shot, is ignored, and an edge only moves by GATE_HYST or
+   more. */
+#define GATE_CELL       8
+#define GATE_COLS       (WIDTH/GATE_CELL)
+#define GATE_ROWS       (HEIGHT/GATE_CELL)
+#define GATE_BANDS      8
+#define GATE_REFRESH    (6*GATE_BANDS)
+#define GATE_DARK       32
+#define GATE_CLEAR      235
+#define GATE_STILL      4
+#define GATE_RUN        3
+#define GATE_INSET      GATE_CELL
+#define GATE_HYST       (2*GATE_CELL)
+#define GATE_TAG        0x47415431 // "GAT1"
+#define GATE_PICTURE(mn,mx)  ((mx) >= GATE_DARK && (mn) <= GATE_CLEAR && (mx) - (mn) >= GATE_STILL)
+// Index of the outermost of the first GATE_RUN picture entries walking from
+// 'from' by 'step' over half of count, -1 if there are none
+#define GATE_EDGE(mn,mx,from,step,count,edge)                                      \
+do{ int _i = (from), _run = 0, _k;                                                 \
+    (edge) = -1;                                                                   \
+    for (_k = 0; _k < (count)/2; _k++, _i += (step)) {                             \
+        _run = GATE_PICTURE((mn)[_i], (mx)[_i]) ? _run + 1 : 0;                    \
+        if(_run == GATE_RUN) { (edge) = _i - (step)*(GATE_RUN-1); break; }         \
+    }                                                                              \
+}while(0)
+
+/* Film weave.  Each frame a row projection (WEAVE_ROWS rows centred in the
+   metering window, each the sum of WEAVE_RUNS runs of WEAVE_RUN pixels, a
+   cache line or two apiece) and a column projection (WEAVE_COLS columns,
+   summed over WEAVE_XROWS rows spread over the window) are matched against
+   the last frame's at every shift up to WEAVE_LAG pixels: the lowest sum of
+   absolute differences wins, the parabola through it and its neighbours
+   gives the 1/16 pixel.  The last frame's projection is scaled to the same
+   total first, so an exposure change doesn't look like motion.  Scene
+   motion counts as much as weave, the stabiliser has to tell them apart. */
+#define WEAVE_ROWS      160
+#define WEAVE_RUNS      3
+#define WEAVE_RUN       32
+#define WEAVE_COLS      160
+#define WEAVE_XROWS     32
+#define WEAVE_LAG       12
+#define WEAVE_HEADER    10  // words: tag, ring base, slot, x window, y window, buffer, WEAVE_PUB_*
+// Shift of prof (n entries) against its last frame's copy last, as the
+// picture's move in 1/16 pixels (off) and a 0-255 confidence: how far the
+// best match is below the average over all shifts.
+#define WEAVE_MATCH(prof,last,n,off,conf)                                          \
+do{ uint32_t _sad[2*WEAVE_LAG+1], _sc = 0, _sl = 0, _k, _best = 0xffffffff, _all = 0;\
+    int _i, _d, _bd = 0;                                                           \
+    for (_i = WEAVE_LAG; _i < (n) - WEAVE_LAG; _i++) {                             \
+        _sc += (prof)[_i];                                                         \
+        _sl += (last)[_i];                                                         \
+    }                                                                              \
+    _k = _sl ? (_sc << 8) / _sl : 256;                                             \
+    if(_k > 1024) _k = 1024;                                                       \
+    for (_d = -WEAVE_LAG; _d <= WEAVE_LAG; _d++) {                                 \
+        uint32_t _s = 0;                                                           \
+        for (_i = WEAVE_LAG; _i < (n) - WEAVE_LAG; _i++) {                         \
+            int _e = (int)(prof)[_i] - (int)(((last)[_i+_d] * _k) >> 8);           \
+            _s += _e < 0 ? -_e : _e;                                               \
+        }                                                                          \
+        _sad[_d+WEAVE_LAG] = _s;                                                   \
+        _all += _s;                                                                \
+        if(_s < _best) { _best = _s; _bd = _d; }                                   \
+    }                                                                              \
+    (off) = -_bd*16;                                                               \
+    (conf) = 0;                                                                    \
+    if(_bd > -WEAVE_LAG && _bd < WEAVE_LAG) {   /* not at the end of the search */ \
+        int _a = _sad[_bd+WEAVE_LAG-1], _b = _best, _c = _sad[_bd+WEAVE_LAG+1];    \
+        if(_a + _c - 2*_b > 0)                                                     \
+            (off) -= ((_a - _c) * 8) / (_a + _c - 2*_b);                           \
+        _all /= 2*WEAVE_LAG+1;                                                     \
+        if(_all > 0)                                                               \
+            (conf) = ((_all - _best) * 255) / _all;                                \
+    }                                                                              \
+}while(0)
+
 
 
 void calc_histogram(void)
 {
-	asm volatile (
-		".word 0x202d2d2d\n" //--- 
-		".word 0x20545543\n" //CUT 
-		".word 0x45524548\n" //HERE
-		".word 0x2d2d2d20\n" //--- 
-	);
-
-	int* frameno = (int *)0x80f8214c; //frame counter
-	uint16_t *histogram_stats = (uint16_t *)  0x85bf0100; // was 85bf0100
+	CUT_HERE();
+#if PROFILE
+	uint32_t prof_t0;
+	CP0_COUNT(prof_t0);
+#endif
+
+	int* frameno = MM(int *, ADDR_FRAMENO); //frame counter
+	uint16_t *histogram_stats = MM(uint16_t *, SCRATCH_HIST_STATS); // was 85bf0100
 	uint8_t  *histo_rgb_image = 0;// = (uint8_t *) (0x85bf0000 - (HIST_PITCH * HIST_HEIGHT * 3)); // was 85bf0500  (seems to effect the encoder buffer.)
-	uint32_t *expo_change = (uint32_t *)0x85bf0010;
-	uint32_t *enc_frames = (uint32_t *) 0x85bf0014;
+	uint32_t *expo_change = MM(uint32_t *, SCRATCH_EXPO_CHANGE);
+	uint32_t *enc_frames = MM(uint32_t *, SCRATCH_ENC_FRAMES);
 	//uint32_t *count_frames = (uint32_t *)0x85bf0018;
-	uint32_t *current_Qp = (uint32_t *) 0xa56f1f60;
-    uint32_t *wb_gains = (uint32_t *)0x85bf0020;
-    uint32_t *window_res = (uint32_t *)0x85bf0030;
-    uint8_t *LCD = (uint8_t *)0x81821180; // All types
+	uint32_t *current_Qp = MM(uint32_t *, ADDR_CURRENT_QP);
+    uint32_t *wb_gains = MM(uint32_t *, SCRATCH_WB_GAINS);
+    uint32_t *window_res = MM(uint32_t *, SCRATCH_WINDOW_RES);
+    uint8_t *LCD = MM(uint8_t *, ADDR_LCD); // All types
     
-	uint8_t *imagebase = (uint8_t *)0xa2730b70; //start of LRV  //PREVIEW
+	uint8_t *imagebase = MM(uint8_t *, ADDR_RING_PREVIEW); //start of LRV  //PREVIEW
   /*uint8_t *image = (uint8_t *)0x827c8970; //start of LRV
 	uint8_t *image = (uint8_t *)0x82860770; //start of LRV
 	uint8_t *image = (uint8_t *)0x828f8570; //start of LRV
@@ -342,7 +751,7 @@ void calc_histogram(void)
 
     if(*enc_frames > 0 && *enc_frames < 99999)
     {
-        imagebase = (uint8_t *)0xa37AB770; //start of LRV //0xAxxxxxxx - uncached
+        imagebase = MM(uint8_t *, ADDR_RING_ENCODE); //start of LRV //0xAxxxxxxx - uncached
     }
     
     if(!(*expo_change == 0xffff0000 || *enc_frames > 0))
@@ -350,11 +759,11 @@ void calc_histogram(void)
     
     uint32_t *hist[5];
     
-    hist[0] = (uint32_t *)0x86000000;
-    hist[1] = (uint32_t *)0x86300000; 
-    hist[2] = (uint32_t *)0x86600000; 
-    hist[3] = (uint32_t *)0x86900000; 
-    hist[4] = (uint32_t *)0x86c00000; 
+    hist[0] = MM(uint32_t *, ADDR_OVERLAY0);
+    hist[1] = MM(uint32_t *, ADDR_OVERLAY1);
+    hist[2] = MM(uint32_t *, ADDR_OVERLAY2);
+    hist[3] = MM(uint32_t *, ADDR_OVERLAY3);
+    hist[4] = MM(uint32_t *, ADDR_OVERLAY4);
     //hist[0] = (uint32_t *)0x87600000;  // doesn't hurt, doesn't help
     //hist[1] = (uint32_t *)0x87800000; 
     //hist[2] = (uint32_t *)0x87a00000; 
@@ -409,49 +818,186 @@ void calc_histogram(void)
     //histogram_stats = (uint16_t *)histo_rgb_image;
     //histogram_stats -= 0x1000;
     
-	volatile int* reelType = (int *)0x80340000;
-    volatile uint32_t* button = (uint32_t *)0xA0E8BFF8; // uncached
-    int32_t* nvm_base = (uint32_t *)0x80E0B78C; //Type A - exposure, sharpness, tint
-	int* expo_iso = (int *)0x80e56134; //Type A - sensor ISO 
-       
-	if(*reelType == 2)
-    {
-        expo_iso = (int *)0x80e56224; //sensor ISO
-        nvm_base = (int *)0x80E0B87C; //exposure, sharpness, tint    
-        button = (uint32_t *)0xA0E8C0E8;
-    }
-	if(*reelType == 3)
-    {
-		expo_iso = (int *)0x80e556b4; //sensor ISO
-        nvm_base = (int *)0x80E0AD0C; //exposure, sharpness, tint
-        button = (uint32_t *)0xA0E8B578;
-    }
+	int reelType = REEL_TYPE(); // 1, 2 or 3, a constant in a REEL= build
+    volatile uint32_t* button = MM(uint32_t *, REEL_ADDR(BUTTON, reelType)); // uncached
+    int32_t* nvm_base = MM(int32_t *, REEL_ADDR(NVM_BASE, reelType)); //exposure, sharpness, tint
+	int* expo_iso = MM(int *, REEL_ADDR(EXPO_ISO, reelType)); //sensor ISO 
 	int* expo_time = expo_iso + 1;
     
     if(button[3] > 0 && button[0] == BUTTON_OK) 
         return;  // don't do anything with OK pressed.
     
-	for (int i = 0; i < NUM_BINS*4; i++) 
-		histogram_stats[i] = 0;
-	
-	uint32_t *pixels = (uint32_t *)imagebase; // first pixels
-	int j,current_frame = 0;
-	for(j=0; j<6; j++)
+#if PROFILE
+    uint32_t prof_acc[PROF_HIST+1], prof_last = prof_t0;
+    int prof_ph = PROF_HIST;   // setup, only counted in the total
+    for (int i = 0; i <= PROF_HIST; i++)
+        prof_acc[i] = 0;
+#endif
+
+    PHASE(sample);
+    PROF_MARK(PROF_SAMPLE);
+	// Ring tracker.  The ISP/encoder fills the six frames in order and its
+	// first write to a frame replaces the first pixels, so every completed
+	// frame is stamped there with RING_STAMP: a frame that lost its stamp
+	// has been started since.  Going on from the frame being written last
+	// call, the furthest started frame that is followed by a stamped one is
+	// being written now; the one the ISP finished before it is stable and
+	// is what gets sampled and drawn on.  That copes with the ISP skipping
+	// or repeating a slot, and costs one read per slot it moved on plus
+	// one.  With no new frame since the last call there is nothing to do;
+	// on the first call, a preview/encode switch, or when every stamp is
+	// gone, all frames are stamped and the next call finds the ring.
+	uint32_t *ring = MM(uint32_t *, SCRATCH_RING_STATE); // tag, ring base, writing, done
+	uint32_t *first = (uint32_t *)imagebase; // first pixels, uncached
+	int j,k,current_frame,writing = -1,seen = 0;
+	int last = ring[0] == RING_TAG && ring[1] == (uint32_t)(uintptr_t)imagebase ? (int)ring[2] : -1;
+	int done = last < RING_FRAMES ? last : -1;  // finished since, if the ISP moved on
+	for(k=1; last >= 0 && k<=RING_FRAMES; k++)
 	{
-		if(*pixels != 0) current_frame = j;
-		*pixels = 0;
-		
-		pixels += 0x97e00>>2;  //next frame in the six 
+		j = (last < RING_FRAMES ? last : RING_FRAMES-1) + k;
+		if(j >= RING_FRAMES) j -= RING_FRAMES;
+		if(first[j*(RING_STRIDE>>2)] != RING_STAMP(j))
+		{
+			if(writing >= 0) done = writing;
+			writing = j;
+		}
+		else
+		{
+			seen = 1;
+			if(writing >= 0) break;
+		}
+	}
+	if(!seen)
+	{
+		for(j=0; j<RING_FRAMES; j++)
+			first[j*(RING_STRIDE>>2)] = RING_STAMP(j);
+		ring[0] = RING_TAG;
+		ring[1] = (uint32_t)(uintptr_t)imagebase;
+		ring[2] = RING_FRAMES;      // all stamped, writer not known yet
+		return;
 	}
+	if(writing < 0 || writing == last)
+		return;  // the ISP hasn't moved on
+	current_frame = done >= 0 ? done : writing == 0 ? RING_FRAMES-1 : writing-1;
+	j = last < RING_FRAMES ? last : writing == RING_FRAMES-1 ? 0 : writing+1;
+	for(; j != writing; j = j == RING_FRAMES-1 ? 0 : j+1)
+		first[j*(RING_STRIDE>>2)] = RING_STAMP(j);   // finished since the last call
+	ring[0] = RING_TAG;
+	ring[1] = (uint32_t)(uintptr_t)imagebase;
+	ring[2] = writing;
+	ring[3] = current_frame;
+    
+	for (int i = 0; i < NUM_BINS*4; i++) 
+		histogram_stats[i] = 0;
     
     uint8_t *image = imagebase;
-    image += 0x97e00 * current_frame;
+    image += RING_STRIDE * current_frame;
+#if CACHED_SAMPLING
+    image = KSEG0(uint8_t *, image);
+#endif
     uint8_t* chroma = image + WIDTH*HEIGHT + 0x18600;
+    int phase = *frameno & 15;
+    int gx1 = EDGE_X1, gx2 = WIDTH-EDGE_X2, gy1 = EDGE, gy2 = HEIGHT-EDGE;   // metering window
+#if GATE_DETECT
+    PHASE(gate);
+    {
+        uint32_t *gate = MM(uint32_t *, SCRATCH_GATE); // tag, frame, window, projections
+        uint16_t *win = (uint16_t *)&gate[2];          // x1, x2, y1, y2
+        uint16_t *colsum = (uint16_t *)&gate[4];
+        uint8_t *colmin = (uint8_t *)&colsum[GATE_COLS], *colmax = colmin + GATE_COLS;
+        uint8_t *rowmin = colmax + GATE_COLS, *rowmax = rowmin + GATE_ROWS;
+        int n, c, r;
+        
+        if(gate[0] != GATE_TAG)
+        {
+            win[0] = gx1; win[1] = gx2; win[2] = gy1; win[3] = gy2;
+            for (c = 0; c < GATE_COLS; c++) { colsum[c] = 0; colmin[c] = 255; colmax[c] = 0; }
+            for (r = 0; r < GATE_ROWS; r++) { rowmin[r] = 255; rowmax[r] = 0; }
+            gate[1] = 0;
+            gate[0] = GATE_TAG;
+        }
+        n = gate[1];
+        
+        for (r = n % GATE_BANDS; r < GATE_ROWS; r += GATE_BANDS) {
+            uint8_t *row = &image[(r*GATE_CELL + GATE_CELL/2)*PITCH + GATE_CELL/2];
+            uint32_t s = 0, m;
+#if CACHED_SAMPLING
+            CACHE_INV_RANGE(row, &row[(GATE_COLS-1)*GATE_CELL + 1]);
+#endif
+            for (c = 0; c < GATE_COLS; c++) {
+                uint32_t p = row[c*GATE_CELL];
+                s += p;
+                colsum[c] += p;
+            }
+            m = s / GATE_COLS;
+            if(m < rowmin[r]) rowmin[r] = m;
+            if(m > rowmax[r]) rowmax[r] = m;
+        }
+        if(n % GATE_BANDS == GATE_BANDS-1)
+        {
+            for (c = 0; c < GATE_COLS; c++) {
+                uint32_t m = colsum[c] / GATE_ROWS;
+                if(m < colmin[c]) colmin[c] = m;
+                if(m > colmax[c]) colmax[c] = m;
+                colsum[c] = 0;
+            }
+        }
+        
+        if(++n == GATE_REFRESH)
+        {
+            int left, right, top, bottom;
+            GATE_EDGE(colmin, colmax, 0, 1, GATE_COLS, left);
+            GATE_EDGE(colmin, colmax, GATE_COLS-1, -1, GATE_COLS, right);
+            GATE_EDGE(rowmin, rowmax, 0, 1, GATE_ROWS, top);
+            GATE_EDGE(rowmin, rowmax, GATE_ROWS-1, -1, GATE_ROWS, bottom);
+            if(left >= 0 && right >= 0 && top >= 0 && bottom >= 0)
+            {
+                int w[4], changed = 0;
+                w[0] = left*GATE_CELL + GATE_INSET;
+                w[1] = (right+1)*GATE_CELL - GATE_INSET;
+                w[2] = top*GATE_CELL + GATE_INSET;
+                w[3] = (bottom+1)*GATE_CELL - GATE_INSET;
+                if(w[1] - w[0] >= WIDTH/2 && w[3] - w[2] >= HEIGHT/2)
+                {
+                    for (c = 0; c < 4; c++) {
+                        if(w[c] >= win[c] + GATE_HYST || w[c] + GATE_HYST <= win[c]) {
+                            win[c] = w[c];
+                            changed = 1;
+                        }
+                    }
+                }
+                if(changed)
+                {
+                    // other sample count: restart the history, skip one cut check
+#if SPARSE_SAMPLING
+                    *MM(uint32_t *, SCRATCH_HIST_ACCUM) = 0;
+#endif
+                    *MM(uint32_t *, SCRATCH_CUT_STATE) = 0;
+                }
+            }
+            for (c = 0; c < GATE_COLS; c++) { colmin[c] = 255; colmax[c] = 0; }
+            for (r = 0; r < GATE_ROWS; r++) { rowmin[r] = 255; rowmax[r] = 0; }
+            n = 0;
+        }
+        gate[1] = n;
+        gx1 = win[0]; gx2 = win[1]; gy1 = win[2]; gy2 = win[3];
+    }
+    PHASE(sample);
+#endif
+    int y0 = gy1 + SAMPLE_DY(phase), x0 = gx1 + SAMPLE_DX(phase);
+#if CACHED_SAMPLING
+    // The ISP/encoder DMA doesn't snoop the D-cache, drop any stale copy of
+    // the sampled rows so the first read of each line refills from DRAM.
+    for (int y = y0; y < gy2; y+=SAMPLE_STEP) {
+        CACHE_INV_RANGE(&image[y*PITCH+x0], &image[y*PITCH+gx2]);
+        CACHE_INV_RANGE(&chroma[(y>>1)*PITCH+(x0&0xfffe)], &chroma[(y>>1)*PITCH+gx2]);
+    }
+#endif
   
     int pixel_counted = 0;
     // Compute histogram
-	for (int y = EDGE; y < HEIGHT-EDGE; y+=4) {
-		for (int x = EDGE_X1; x < WIDTH-EDGE_X2; x+=4) {
+	for (int y = y0; y < gy2; y+=SAMPLE_STEP) {
+		for (int x = x0; x < gx2; x+=SAMPLE_STEP) {
             int yy,u,v,r,g,b;
             
             yy = image[y*PITCH+x];
@@ -484,103 +1030,214 @@ void calc_histogram(void)
 		}
 	}
 
+#if WEAVE
+    PHASE(weave);
+    PROF_MARK(PROF_WEAVE);
+    {
+        uint32_t *wv = MM(uint32_t *, SCRATCH_WEAVE); // tag, base, slot, windows, buffer, dx|dy, conf, frameno
+        int weave_dx = 0, weave_dy = 0, weave_cx = 0, weave_cy = 0, weave_ok = 0;
+        int buf = wv[0] == WEAVE_TAG ? wv[5] ^ 1 : 0;
+        uint16_t *rows = (uint16_t *)&wv[WEAVE_HEADER] + buf*(WEAVE_ROWS+WEAVE_COLS);
+        uint16_t *cols = rows + WEAVE_ROWS;
+        uint16_t *last_rows = (uint16_t *)&wv[WEAVE_HEADER] + (buf^1)*(WEAVE_ROWS+WEAVE_COLS);
+        uint16_t *last_cols = last_rows + WEAVE_ROWS;
+        // the window is at least half the frame, so these fit
+        int ry0 = (gy1 + gy2 - WEAVE_ROWS) >> 1, cx0 = (gx1 + gx2 - WEAVE_COLS) >> 1;
+        int run = (gx2 - gx1) / (WEAVE_RUNS+1), band = (gy2 - gy1) / WEAVE_XROWS;
+        uint32_t xwin = gx1 | gx2 << 16, ywin = gy1 | gy2 << 16;
+        
+        for (int i = 0; i < WEAVE_ROWS; i++) {
+            uint32_t s = 0;
+            for (int k = 1; k <= WEAVE_RUNS; k++) {
+                uint8_t *p = &image[(ry0+i)*PITCH + gx1 + k*run - WEAVE_RUN/2];
+#if CACHED_SAMPLING
+                CACHE_INV_RANGE(p, p + WEAVE_RUN);
+#endif
+                for (int x = 0; x < WEAVE_RUN; x++)
+                    s += p[x];
+            }
+            rows[i] = s;
+        }
+        for (int x = 0; x < WEAVE_COLS; x++)
+            cols[x] = 0;
+        for (int k = 0; k < WEAVE_XROWS; k++) {
+            uint8_t *p = &image[(gy1 + k*band + (band>>1))*PITCH + cx0];
+#if CACHED_SAMPLING
+            CACHE_INV_RANGE(p, p + WEAVE_COLS);
+#endif
+            for (int x = 0; x < WEAVE_COLS; x++)
+                cols[x] += p[x];
+        }
+        
+        // same ring, a new frame, and the same places sampled
+        if(wv[0] == WEAVE_TAG && wv[1] == (uint32_t)(uintptr_t)imagebase &&
+           wv[2] != (uint32_t)current_frame && wv[3] == xwin && wv[4] == ywin)
+        {
+            WEAVE_MATCH(rows, last_rows, WEAVE_ROWS, weave_dy, weave_cy);
+            WEAVE_MATCH(cols, last_cols, WEAVE_COLS, weave_dx, weave_cx);
+            weave_ok = 1;
+        }
+        wv[1] = (uint32_t)(uintptr_t)imagebase;
+        wv[2] = current_frame;
+        wv[3] = xwin;
+        wv[4] = ywin;
+        wv[5] = buf;
+        wv[WEAVE_PUB_FRAMENO] = 0;
+        COMPILER_BARRIER();
+        wv[WEAVE_PUB_DXDY] = (uint16_t)weave_dx | (uint32_t)weave_dy << 16;
+        wv[WEAVE_PUB_CONF] = weave_cx | weave_cy << 8 | (weave_ok ? WEAVE_PUB_OK : 0);
+        COMPILER_BARRIER();
+        wv[WEAVE_PUB_FRAMENO] = *frameno;
+        wv[0] = WEAVE_TAG;
+    }
+    PHASE(sample);
+    PROF_MARK(PROF_SAMPLE);
+#endif
+
+    uint32_t *ae_state = MM(uint32_t *, SCRATCH_AE_STATE); // tag, correcting, settle frames, fast frames
+    if(ae_state[0] != AE_STATE_TAG)
+    {
+        ae_state[0] = AE_STATE_TAG;
+        ae_state[1] = 1;
+        ae_state[2] = 0;
+        ae_state[3] = 0;
+    }
+    
+    {
+        uint32_t *cut_state = MM(uint32_t *, SCRATCH_CUT_STATE); // tag, last distance, CUT_BINS uint16_t
+        uint16_t *prev = (uint16_t *)&cut_state[2];
+        uint32_t dist = 0;
+        for (int i = 0; i < CUT_BINS; i++) {
+            uint32_t s = 0;
+            for (int k = 0; k < NUM_BINS/CUT_BINS; k++)
+                s += histogram_stats[i*(NUM_BINS/CUT_BINS) + k];
+            dist += s > prev[i] ? s - prev[i] : prev[i] - s;
+            prev[i] = s;
+        }
+        if(cut_state[0] == CUT_TAG && dist > ((uint32_t)pixel_counted >> CUT_SHIFT) &&
+           ae_state[1] == 0 && ae_state[2] == 0)
+        {
+            ae_state[1] = 1;
+            ae_state[3] = AE_FAST_FRAMES;
+#if SPARSE_SAMPLING
+            *MM(uint32_t *, SCRATCH_HIST_ACCUM) = 0;  // meter from this frame only
+#endif
+        }
+        cut_state[0] = CUT_TAG;
+        cut_state[1] = dist;
+    }
+
+#if SPARSE_SAMPLING
+    // acc -= acc>>HIST_DECAY, acc += this frame, published back as uint16_t
+    // bins (and total) on the same scale as a full every 4th pixel frame.
+    {
+        uint32_t *acc = MM(uint32_t *, SCRATCH_HIST_ACCUM); // tag, total, 4 x 128 bins
+        int fresh = acc[0] != HIST_ACC_TAG;
+        acc[0] = HIST_ACC_TAG;
+        for (int i = 0; i < NUM_BINS*4; i++) {
+            uint32_t a = acc[2+i], n = (uint32_t)histogram_stats[i] << HIST_FRAC;
+            a = fresh ? n << HIST_DECAY : a - (a >> HIST_DECAY) + n;
+            acc[2+i] = a;
+            histogram_stats[i] = a >> HIST_FRAC;
+        }
+        uint32_t a = acc[1], n = (uint32_t)pixel_counted << HIST_FRAC;
+        acc[1] = a = fresh ? n << HIST_DECAY : a - (a >> HIST_DECAY) + n;
+        pixel_counted = a >> HIST_FRAC;
+    }
+#endif
+
+    uint32_t *hist_cdf = MM(uint32_t *, SCRATCH_HIST_CDF);
+    BUILD_HIST_CDF(hist_cdf, histogram_stats);
+    uint32_t *ycdf = HIST_CDF(hist_cdf, 0);
+
 #if DRAW
+    PHASE(draw);
+    PROF_MARK(PROF_DRAW);
 //if(*enc_frames >= 200)
 //{
+    // Borders and bars persist in the overlay buffer, everything is drawn
+    // again when another buffer was picked, this one was overwritten, or
+    // every OVERLAY_REFRESH frames in case the firmware cleared it without
+    // touching the two border bytes checked here.
+    uint32_t *ovl_owner = MM(uint32_t *, SCRATCH_OVERLAY_STATE);
+    uint32_t *ovl_age = ovl_owner + 1;
+    uint8_t *ovl_q = (uint8_t *)(ovl_owner + 2);
+    int redraw = *ovl_owner != (uint32_t)(uintptr_t)histo_rgb_image || *ovl_age >= OVERLAY_REFRESH ||
+                 histo_rgb_image[0] != 0x55 || histo_rgb_image[3*OVL_PLANE - OVL_STRIDE] != 0x55;
+    *ovl_owner = (uint32_t)(uintptr_t)histo_rgb_image;
+    *ovl_age = redraw ? 1 : *ovl_age + 1;
+    
     uint8_t *planes = histo_rgb_image;
-    uint32_t *planes32 = (uint32_t *)histo_rgb_image;
-    //if(planes[0] != 63)
+    if(redraw)
     {  
         for(int rgb=0; rgb<3; rgb++)
         {
 	        for (int y = 0; y < HIST_HEIGHT; y++) {
-	           planes[y * HIST_PITCH + 0] = 63;                    // Left border
-	           planes[y * HIST_PITCH + 1] = 63;                    // Left border
-	           planes[y * HIST_PITCH + 2] = 1;                     // Left border
-	           planes[y * HIST_PITCH + 3] = 1;                     // Left border
-	           planes[y * HIST_PITCH + HIST_WIDTH - 1] = 63;       // Right border
-	           planes[y * HIST_PITCH + HIST_WIDTH - 2] = 63;       // Right border
-	           planes[y * HIST_PITCH + HIST_WIDTH - 3] = 1;        // Right border
-	           planes[y * HIST_PITCH + HIST_WIDTH - 4] = 1;        // Right border
-	        }
-	        for (int x = 1; x < HIST_WIDTH-1; x++) {
-	           planes[x] = 63;                                      // Top border
-	           planes[x+HIST_PITCH] = 63;                           // Top border
-	           planes[x+HIST_PITCH*2] = 1;                          // Top border
-	           planes[x+HIST_PITCH*3] = 1;                          // Top border
-	           planes[(HIST_HEIGHT - 1) * HIST_PITCH + x] = 63;     // Bottom border
-	           planes[(HIST_HEIGHT - 2) * HIST_PITCH + x] = 63;     // Bottom border
-	           planes[(HIST_HEIGHT - 3) * HIST_PITCH + x] = 1;      // Bottom border
-	           planes[(HIST_HEIGHT - 4) * HIST_PITCH + x] = 1;      // Bottom border
+	           uint8_t *row = &planes[y * OVL_STRIDE];
+	           if(y < 2 || y >= HIST_HEIGHT - 2)
+	           {
+	               for (int x = 0; x < HIST_WIDTH/4; x++)
+	                   row[x] = 0x55;                               // Top/Bottom border, all 63
+	           }
+	           else if(y < 4 || y >= HIST_HEIGHT - 4)
+	           {
+	               row[0] = OVL_EDGE;                               // 63,1,1,1
+	               for (int x = 1; x < HIST_WIDTH/4 - 1; x++)
+	                   row[x] = 0;                                  // Top/Bottom border, all 1
+	               row[HIST_WIDTH/4 - 1] = OVL_EDGE << 6;           // 1,1,1,63
+	           }
+	           else
+	           {
+	               row[0] = OVL_EDGE | OVL_EDGE << 2;               // Left border 63,63,1,1
+	               row[HIST_WIDTH/4 - 1] = OVL_EDGE << 4 | OVL_EDGE << 6; // Right border 1,1,63,63
+	           }
+	           #if DRAW_RGB
+	           for (int x = HIST_WIDTH/4; x < OVL_STRIDE; x++)
+	               row[x] = 0;
+	           #endif
 	        }
-           
-           #if DRAW_RGB
-            for (int y = 0; y < HIST_HEIGHT; y++) {
-                int off = (y * HIST_PITCH + HIST_WIDTH)>>2;
-                for(int x=0; x<(TEXT_WIDTH/4); x++) {
-	                planes32[off+x] = 0x01010101;
-                }
-            }
-           #endif
             
-            planes += HIST_PITCH * HIST_HEIGHT;
-            planes32 += (HIST_PITCH * HIST_HEIGHT)>>2;
+            planes += OVL_PLANE;
         }
     }
 
+    PHASE(text);
+    PROF_MARK(PROF_TEXT);
     char *text;
     
     int power = 2*nvm_base[NVM_ISOMAX]; //0,2,4
     if(power == 0) power = 1;        
     if(power > 4) power = 4;        
     if(*enc_frames > 0)
-    {
+    {
 //Frm:           
-//WB gains:      
-// 432,256,256  
-//ev : +0       
-//FPS: 18        
-//Qp : 25 / 27  
-//ISO: 400        
+//WB gains:      
+// 432,256,256  
+//ev : +0       
+//FPS: 18        
+//Qp : 25 / 27  
+//ISO: 400        
 //Exp:xxxxus   
-        char *formattedTextEnc = (char *)0x8033b500;
+        char *formattedTextEnc = MM(char *, ADDR_TEXT_ENC);
         text = formattedTextEnc;
     
-        // Frame number
-        text[4] = ( *enc_frames / 10000) + '0';
-        text[5] = ((*enc_frames / 1000) % 10) + '0';
-        text[6] = ((*enc_frames / 100) % 10) + '0';
-        text[7] = ((*enc_frames / 10) % 10) + '0';
-        text[8] = (*enc_frames % 10) + '0';
-        if(text[4] == '0')
+        // Frame number, counted up in BCD alongside enc_frames
+        uint32_t *frame_bcd = MM(uint32_t *, SCRATCH_FRAME_BCD); // tag, value, bcd
+        if(frame_bcd[0] != BCD_TAG || frame_bcd[1] != *enc_frames)
         {
-            text[4] = ' ';
-            if(text[5] == '0')
-            {
-                text[5] = ' ';
-                if(text[6] == '0')
-                {
-                    text[6] = ' ';
-                    if(text[7] == '0')
-                    {
-                        text[7] = ' ';
-                    }
-                }
-            }
+            if(frame_bcd[0] == BCD_TAG && frame_bcd[1] + 1 == *enc_frames)
+                BCD_INC(frame_bcd[2]);
+            else
+                BCD_FROM(frame_bcd[2], *enc_frames);
+            frame_bcd[0] = BCD_TAG;
+            frame_bcd[1] = *enc_frames;
         }
+        FMT_BCD(&text[4], frame_bcd[2], 5, ' ');
+        
         //WB values
         text[2*16+0] = ' ';
-        text[2*16+1] = (wb_gains[0] / 100) + '0';
-        text[2*16+2] = ((wb_gains[0] / 10) % 10) + '0';
-        text[2*16+3] = (wb_gains[0] % 10) + '0';
         text[2*16+4] = ',';             
-        text[2*16+5] = (wb_gains[1] / 100) + '0';
-        text[2*16+6] = ((wb_gains[1] / 10) % 10) + '0';
-        text[2*16+7] = (wb_gains[1] % 10) + '0';
         text[2*16+8] = ',';             
-        text[2*16+9] = (wb_gains[2] / 100) + '0';
-        text[2*16+10] = ((wb_gains[2] / 10) % 10) + '0';
-        text[2*16+11] = (wb_gains[2] % 10) + '0';
         text[2*16+12] = ' ';        
     
         //EV Bias
@@ -619,39 +1276,23 @@ void calc_histogram(void)
         //QP : 25/27  
         if(current_Qp[0] > 30) current_Qp[0]=30;
         if(current_Qp[0] < 16) current_Qp[0]=16;
-        text[5*16+5] = ((current_Qp[0] / 10) % 10) + '0';
-        text[5*16+6] = (current_Qp[0] % 10) + '0';
         text[5*16+7] = '/';
-        text[5*16+8] = (((nvm_base[NVM_QPMIN]-1) / 10) % 10) + '0';
-        text[5*16+9] = ((nvm_base[NVM_QPMIN]-1) % 10) + '0';
         text[5*16+10] = ' ';
-       
-        if(nvm_base[NVM_QPMIN]-1 > current_Qp[0])
-            current_Qp[0] = nvm_base[NVM_QPMIN]-1;
     
         //ISO: 400/400   
-        if(expo_iso[0] == 50)
-        {
-            text[6*16+5] = ' ';
-            text[6*16+6] = '5';
-        }
-        else
-        {
-            text[6*16+5] = (expo_iso[0] / 100) + '0';
-            text[6*16+6] = '0';
-        }
         text[6*16+8] = '/';
         text[6*16+9] = power + '0';
         text[6*16+12] = ' ';
     
         //Exp:xxxxus [L]
-        text[7*16+4] = (expo_time[0] / 1000) + '0';
-        text[7*16+5] = ((expo_time[0] / 100) % 10) + '0';
-        text[7*16+6] = ((expo_time[0] / 10) % 10) + '0';
-        text[7*16+7] = (expo_time[0] % 10) + '0';
         text[7*16+10] = ' ';
         text[7*16+11] = ((nvm_base[NVM_EXPLOCK] & 1) ? 'L' : 'A');    
         text[7*16+12] = ' ';
+        
+        TEXT_FIELDS_ENC(TEXT_FIELD)
+       
+        if(nvm_base[NVM_QPMIN]-1 > current_Qp[0])
+            current_Qp[0] = nvm_base[NVM_QPMIN]-1;
     
         if(nvm_base[NVM_NAV]==0)  //WB R
         {
@@ -696,85 +1337,117 @@ void calc_histogram(void)
     }
     else
     {    
-//                   
-//WB gains:      
-// 432,256,256  
-//Res:1440x1080  
-//off:512,296    
-//               
-//ISO: 400/400        
+//                   
+//WB gains:      
+// 432,256,256  
+//Res:1440x1080  
+//off:512,296    
+//               
+//ISO: 400/400        
 //Exp:xxxxus     
-        char *formattedTextPrev = (char *)0x8033b600;
+        char *formattedTextPrev = MM(char *, ADDR_TEXT_PREV);
         text = formattedTextPrev;
         int pos = 4;
         
         //WB values
         text[2*16+0] = ' ';
-        text[2*16+1] = (wb_gains[0] / 100) + '0';
-        text[2*16+2] = ((wb_gains[0] / 10) % 10) + '0';
-        text[2*16+3] = (wb_gains[0] % 10) + '0';
         text[2*16+4] = ',';             
-        text[2*16+5] = (wb_gains[1] / 100) + '0';
-        text[2*16+6] = ((wb_gains[1] / 10) % 10) + '0';
-        text[2*16+7] = (wb_gains[1] % 10) + '0';
         text[2*16+8] = ',';             
-        text[2*16+9] = (wb_gains[2] / 100) + '0';
-        text[2*16+10] = ((wb_gains[2] / 10) % 10) + '0';
-        text[2*16+11] = (wb_gains[2] % 10) + '0';
         text[2*16+12] = ' ';
         
         //Res:1440x1080 
-        text[3*16+pos++] = ((window_res[0] / 1000) % 10) + '0';
-        if(text[3*16+pos-1] == '0') pos--;  
-        text[3*16+pos++] = ((window_res[0] / 100) % 10) + '0';
-        text[3*16+pos++] = ((window_res[0] / 10) % 10) + '0';
-        text[3*16+pos++] =  (window_res[0] % 10) + '0';
+        FMT_DEC_LEFT(&text[3*16], pos, window_res[0], 3);
         text[3*16+pos++] = 'x';
-        text[3*16+pos++]  = ((window_res[1] / 1000) % 10) + '0';
-        if(text[3*16+pos-1] == '0') pos--;  
-        text[3*16+pos++] = ((window_res[1] / 100) % 10) + '0';
-        text[3*16+pos++] = ((window_res[1] / 10) % 10) + '0';
-        text[3*16+pos++] =  (window_res[1] % 10) + '0';
+        FMT_DEC_LEFT(&text[3*16], pos, window_res[1], 3);
         text[3*16+pos++] = ' ';
         
         //off:512,296  
         pos = 4;
-        text[4*16+pos++] = ((window_res[2] / 1000) % 10) + '0';
-        if(text[4*16+pos-1] == '0') pos--;  
-        text[4*16+pos++] = ((window_res[2] / 100) % 10) + '0';
-        text[4*16+pos++] = ((window_res[2] / 10) % 10) + '0';
-        text[4*16+pos++] =  (window_res[2] % 10) + '0';
+        FMT_DEC_LEFT(&text[4*16], pos, window_res[2], 3);
         text[4*16+pos++] = ',';
-        text[4*16+pos++]  = ((window_res[3] / 1000) % 10) + '0';
-        if(text[4*16+pos-1] == '0') pos--;  
-        text[4*16+pos++] = ((window_res[3] / 100) % 10) + '0';
-        text[4*16+pos++] = ((window_res[3] / 10) % 10) + '0';
-        text[4*16+pos++] =  (window_res[3] % 10) + '0';
+        FMT_DEC_LEFT(&text[4*16], pos, window_res[3], 3);
         text[4*16+pos++] = ' ';        
         
-        //ISO: 400   
-        if(expo_iso[0] == 50)
+        //ISO: 400, Exp:xxxxus
+        TEXT_FIELDS_PREV(TEXT_FIELD)
+        
+        //Avg:118 Hi:216, metered luma mean and the AE highlight percentile
+        if(HIST_TOTAL(ycdf) > 0)
         {
-            text[6*16+5] = ' ';
-            text[6*16+6] = '5';
+            uint32_t hi;
+            HIST_TOP_PCT(ycdf, HIST_TOTAL(ycdf)>>AE_PCT_SHIFT, hi);
+            text[5*16+0] = 'A'; text[5*16+1] = 'v'; text[5*16+2] = 'g'; text[5*16+3] = ':';
+            FMT_DEC(&text[5*16+4], (2*HIST_WSUM(hist_cdf,0) + HIST_TOTAL(ycdf)) / HIST_TOTAL(ycdf), 3, ' ');
+            text[5*16+7] = ' '; text[5*16+8] = 'H'; text[5*16+9] = 'i'; text[5*16+10] = ':';
+            FMT_DEC(&text[5*16+11], hi*2+1, 3, ' ');
         }
-        else
+    }
+    
+    //WB gains: M, A, P or C, presets, auto, film base profile or capturing it,
+    //the last navigation item
+    int wb_nav = *enc_frames > 0 && nvm_base[NVM_NAV] == 8;
+    text[1*16+10] = wb_nav ? '[' : ' ';
+    int wb_mode = (nvm_base[NVM_WB_MODS] & WB_MODS_MODE) >> WB_MODS_MODE_SHIFT;
+    text[1*16+11] = wb_mode == WB_MODE_AUTO ? 'A' : wb_mode == WB_MODE_PROFILE ? 'P' :
+                    wb_mode == WB_MODE_CALIBRATE ? 'C' : 'M';
+    text[1*16+12] = wb_nav ? ']' : ' ';
+    
+#if PROFILE && PROFILE_OVERLAY
+    //Hk:12/30% Wb:1, calc_histogram average/max and select_wb average in %
+    //of the average frame period, as of the last frame
+    {
+        uint32_t *prof = MM(uint32_t *, SCRATCH_PROFILE);
+        uint32_t unit = (PROF_ENTRY(prof, PROF_PERIOD)[PROF_AVG] >> PROF_AVG_SHIFT) / 100;
+        if(prof[0] == PROF_TAG && unit > 0)
         {
-            text[6*16+5] = (expo_iso[0] / 100) + '0';
-            text[6*16+6] = '0';
+            uint32_t avg = (PROF_ENTRY(prof, PROF_HIST)[PROF_AVG] >> PROF_AVG_SHIFT) / unit;
+            uint32_t max = PROF_ENTRY(prof, PROF_HIST)[PROF_MAX] / unit;
+            uint32_t wb = (PROF_ENTRY(prof, PROF_WB)[PROF_AVG] >> PROF_AVG_SHIFT) / unit;
+            char *row = &text[1*16];
+            row[0] = 'H'; row[1] = 'k'; row[2] = ':';
+            FMT_DEC(&row[3], avg > 99 ? 99 : avg, 2, ' ');
+            row[5] = '/';
+            FMT_DEC(&row[6], max > 99 ? 99 : max, 2, ' ');
+            row[8] = '%'; row[9] = ' ';
+            row[10] = 'W'; row[11] = 'b'; row[12] = ':';
+            FMT_DEC(&row[13], wb > 99 ? 99 : wb, 2, ' ');
         }
-    
-        //Exp:xxxxus
-        text[7*16+4] = (expo_time[0] / 1000) + '0';
-        text[7*16+5] = ((expo_time[0] / 100) % 10) + '0';
-        text[7*16+6] = ((expo_time[0] / 10) % 10) + '0';
-        text[7*16+7] = (expo_time[0] % 10) + '0';
     }
-    
-    DRAW_TEXT_V(LCD, LCD_P, LCD_X, LCD_Y, 764, 360, text, GREY215);
- 
+#endif
 
+    uint32_t *atlas = MM(uint32_t *, SCRATCH_GLYPH_ATLAS);
+    uint32_t *glyphs = &atlas[ATLAS_HEADER];
+    uint32_t *text_cache = MM(uint32_t *, SCRATCH_TEXT_CACHE);
+    if(atlas[0] == ATLAS_TAG && atlas[2] < ATLAS_SIZE)
+    {
+        uint32_t pos = atlas[2], end = pos + ATLAS_SLICE, sum = pos ? atlas[3] : 0;
+        if(end > ATLAS_SIZE) end = ATLAS_SIZE;
+        for(; pos < end; pos++)
+            sum = ATLAS_SUM(sum, glyphs[pos]);
+        if(pos == ATLAS_SIZE)
+        {
+            if(sum != atlas[1]) atlas[0] = 0;  // corrupted, rebuilt below
+            pos = 0;
+        }
+        atlas[2] = pos;
+        atlas[3] = sum;
+    }
+    if(atlas[0] != ATLAS_TAG || atlas[2] >= ATLAS_SIZE)
+    {
+        uint32_t sum = 0;
+        BUILD_GLYPH_ATLAS(glyphs);
+        for(int i = 0; i < ATLAS_SIZE; i++)
+            sum = ATLAS_SUM(sum, glyphs[i]);
+        atlas[1] = sum;
+        atlas[2] = 0;
+        atlas[0] = ATLAS_TAG;
+        text_cache[0] = 0;  // cells drawn from a bad atlas are redrawn
+    }
+    DRAW_TEXT_V_CACHED(LCD, LCD_P, LCD_X, LCD_Y, 764, 360, text, GREY215, text_cache, glyphs);
+ 
 
+    PHASE(draw);
+    PROF_MARK(PROF_DRAW);
 	uint32_t peak = 0;
 	for (uint32_t x = 0; x < NUM_BINS; x++) {
 		uint32_t value = histogram_stats[x];
@@ -784,47 +1457,52 @@ void calc_histogram(void)
     uint32_t y_sqrt_peak;
     ISQRT(val, y_sqrt_peak);
     
-	// draw histogram in memory
-	for (int x = 0; x < 128; x++) {
-		uint32_t rval =  (uint32_t)(histogram_stats[128 + x])<<15;
-		uint32_t gval =  (uint32_t)(histogram_stats[256 + x])<<15;
-		uint32_t bval =  (uint32_t)(histogram_stats[384 + x])<<15;
+	// Bars persist in the overlay, so only the rows between last frame's and
+	// this frame's bar top are rewritten.  q = isqrt(bin<<15)/y_sqrt_peak
+	// (0..64, bar top at 64-q) is kept per column, and is still valid while
+	// (q*p)^2 <= bin<<15 < ((q+1)*p)^2, which skips the ISQRT as well.
+	for (int rgb = 0; rgb < 3; rgb++) {
+		uint8_t *plane = &histo_rgb_image[rgb * OVL_PLANE + 4 * OVL_STRIDE];
+		uint8_t *q_last = &ovl_q[rgb * 128];
 		
-		// integer square root code
-        uint32_t r_sqrt, g_sqrt, b_sqrt;
-        ISQRT(rval, r_sqrt);
-        ISQRT(gval, g_sqrt);
-        ISQRT(bval, b_sqrt);
-    
-		int y;
-        int rvalue = 64 - r_sqrt/y_sqrt_peak;  // Get histogram value
-        int gvalue = 64 - g_sqrt/y_sqrt_peak;  // Get histogram value
-        int bvalue = 64 - b_sqrt/y_sqrt_peak;  // Get histogram value
-        if(rvalue < 0) rvalue = 0;
-        if(gvalue < 0) gvalue = 0;
-        if(bvalue < 0) bvalue = 0;
-        
-		for (y = 63; y > rvalue; y--)
-			histo_rgb_image[(y+4) * HIST_PITCH + (4 + x)] = 127;
-		for (; y >= 0; y--)
-			histo_rgb_image[(y+4) * HIST_PITCH + (4 + x)] = 1;
-
-		for (y = 63; y > gvalue; y--)
-			histo_rgb_image[(HIST_PITCH * HIST_HEIGHT) + (y+4) * HIST_PITCH + (4 + x)] = 127;
-		for (; y >= 0; y--)
-			histo_rgb_image[(HIST_PITCH * HIST_HEIGHT) + (y+4) * HIST_PITCH + (4 + x)] = 1;
-
-		for (y = 63; y > bvalue; y--)
-			histo_rgb_image[(HIST_PITCH * HIST_HEIGHT)*2 + (y+4) * HIST_PITCH + (4 + x)] = 127;
-		for (; y >= 0; y--)
-			histo_rgb_image[(HIST_PITCH * HIST_HEIGHT)*2 + (y+4) * HIST_PITCH + (4 + x)] = 1;
+		for (int x = 0; x < 128; x++) {
+			uint32_t val = (uint32_t)(histogram_stats[128 * (rgb+1) + x])<<15;
+			uint32_t q = q_last[x];
+			uint32_t lo = q * y_sqrt_peak;
+			uint32_t hi = lo + y_sqrt_peak;
+			
+			if(!redraw && val >= lo*lo && (q == 64 || val < hi*hi))
+				continue;  // unchanged
+			
+			// integer square root code
+			uint32_t v_sqrt, nq;
+			ISQRT(val, v_sqrt);
+			nq = v_sqrt/y_sqrt_peak;
+			if(nq > 64) nq = 64;
+			q_last[x] = nq;
+			
+			// rows below the bar top are bar (127), above it background (1)
+			int top = 0, bottom = 63, bar_top = 64 - nq;
+			if(!redraw)
+			{
+				top = 64 - (nq > q ? nq : q) + 1;
+				bottom = 64 - (nq > q ? q : nq);
+				if(bottom > 63) bottom = 63;
+			}
+			for (int y = top; y <= bottom; y++)
+				OVL_SET(plane, 4 + x, y, y > bar_top ? OVL_BAR : OVL_BG);
+		}
 	}
     
     
-    // draw pre-rendered histo_rgb_image into the frame buffer
+    // draw pre-rendered histo_rgb_image into the frame buffer, unless the
+    // ISP has started on the frame again since the tracker picked it
+    PHASE(composite);
+    PROF_MARK(PROF_COMPOSITE);
+    if(first[current_frame*(RING_STRIDE>>2)] == RING_STAMP(current_frame))
     {
         image = imagebase;
-	    image += 0x97e00 * current_frame; // seems to be a 6 frame buffer during preview
+	    image += RING_STRIDE * current_frame; // the completed frame the tracker picked
         
         //current_frame++;
         //current_frame &= 6;
@@ -835,44 +1513,59 @@ void calc_histogram(void)
         ybuff += 380 * PITCH + 16;
         uvbuff += (380/2) * PITCH + 16;
         
-	    // draw histogram to frame
+        // YUV of every (r,g,b) code combination, built once
+        uint32_t *pal_tag = MM(uint32_t *, SCRATCH_OVERLAY_PAL);
+        int16_t *pal = (int16_t *)(pal_tag + 1);
+        if(*pal_tag != OVL_PAL_TAG)
+        {
+            for (int i = 0; i < 64; i++) {
+                int histr = OVL_LEVEL((i >> 4) & 3);
+                int histg = OVL_LEVEL((i >> 2) & 3);
+                int histb = OVL_LEVEL(i & 3);
+                pal[i*4+0] = (218 * histr + 732 * histg +  74 * histb + 512)>>10;
+                pal[i*4+1] = (-117 * histr - 395 * histg + 512 * histb + 512)>>10;
+                pal[i*4+2] = (512 * histr - 465 * histg - 47 * histb + 512)>>10;
+                pal[i*4+3] = 0;
+            }
+            *pal_tag = OVL_PAL_TAG;
+        }
+        
+	    // draw histogram to frame, 4 pixels (two chroma pairs) per overlay byte
 	    for (int y = 0; y < HIST_HEIGHT; y++) {
 		    uint32_t x;
-            uint8_t *src, *dsty, *dstc, pixels;
-		    src = (uint8_t *)&histo_rgb_image[y * HIST_PITCH];
+            uint8_t *srcr, *srcg, *srcb, *dsty, *dstc;
+		    srcr = (uint8_t *)&histo_rgb_image[y * OVL_STRIDE];
+		    srcg = srcr + OVL_PLANE;
+		    srcb = srcg + OVL_PLANE;
 		    dsty = (uint8_t *)&ybuff[y * PITCH];
 		    dstc = (uint8_t *)&uvbuff[(y>>1) * PITCH];
-		    for (x = 0; x < HIST_PITCH; x+=2) {
-                int y1 = dsty[x];
-                int y2 = dsty[x+1];
-                int u = dstc[x] - 128;
-                int v = dstc[x+1] - 128;
+		    for (x = 0; x < HIST_PITCH; x+=4) {
+                uint32_t r = srcr[x>>2], g = srcg[x>>2], b = srcb[x>>2];
                 
-                int histr1 = src[x];
-                int histr2 = src[x+1];
-                int histg1 = src[(HIST_PITCH * HIST_HEIGHT)+x];
-                int histg2 = src[(HIST_PITCH * HIST_HEIGHT)+x+1];
-                int histb1 = src[(HIST_PITCH * HIST_HEIGHT)*2+x];
-                int histb2 = src[(HIST_PITCH * HIST_HEIGHT)*2+x+1];
-                
-                int hy1 = (218 * histr1 + 732 * histg1 +  74 * histb1 + 512)>>10;
-                int hy2 = (218 * histr2 + 732 * histg2 +  74 * histb2 + 512)>>10;
-                int hu1 = (-117 * histr1 - 395 * histg1 + 512 * histb1 + 512)>>10;
-                int hu2 = (-117 * histr2 - 395 * histg2 + 512 * histb2 + 512)>>10;
-                int hv1 = (512 * histr1 - 465 * histg1 - 47 * histb1 + 512)>>10;
-                int hv2 = (512 * histr2 - 465 * histg2 - 47 * histb2 + 512)>>10;
-    
-			    dsty[x] = (hy1 + y1)>>1;
-			    dsty[x+1] = (hy2 + y2)>>1;
-                dstc[x] = ((u + u + hu1 + hu2)>>2) + 128;
-                dstc[x+1] = ((v + v + hv1 + hv2)>>2) + 128;
+                for (int p = 0; p < 4; p+=2, r >>= 4, g >>= 4, b >>= 4) {
+                    int16_t *c1 = &pal[(((r & 0x3)<<4) | ((g & 0x3)<<2) |  (b & 0x3))    *4];
+                    int16_t *c2 = &pal[(((r & 0xc)<<2) |  (g & 0xc)     | ((b & 0xc)>>2))*4];
+                    int u = dstc[x+p] - 128;
+                    int v = dstc[x+p+1] - 128;
+                    
+                    dsty[x+p] = (c1[0] + dsty[x+p])>>1;
+                    dsty[x+p+1] = (c2[0] + dsty[x+p+1])>>1;
+                    dstc[x+p] = ((u + u + c1[1] + c2[1])>>2) + 128;
+                    dstc[x+p+1] = ((v + v + c1[2] + c2[2])>>2) + 128;
+                }
 		    }
 	    }
     }
 //}
 #endif
 
+#if TELEMETRY
+    int tlm_iso = *expo_iso, tlm_time = *expo_time;  // what this frame was taken at
+#endif
+
 #if 1
+    PHASE(ae);
+    PROF_MARK(PROF_AE);
 	{        
 		if(*expo_iso < 50 || *expo_time < 500 || *expo_time > 16386) // initialize
 		{
@@ -902,54 +1595,67 @@ void calc_histogram(void)
 			int newexpo = currexpo;
 			int nextexpo = currexpo;
 			
-			int total = pixel_counted; // total pixels sampled.  
-			int top_stops = 0;
-            int twothirds = 0;
-			int midA_stops = 0;
-			int midB_stops = 0;
-			int midC_stops = 0;
-			int midD_stops = 0;
-			int bot_stops = 0;
-			int clipped = 0;
-             
-			int i=0;
-			for(; i<42; i++) bot_stops += histogram_stats[i]; // bottom third
-			for(; i<64; i++) midA_stops += histogram_stats[i]; // middle third
-			for(; i<85; i++) midB_stops += histogram_stats[i]; // middle third
-			for(; i<96; i++) midC_stops += histogram_stats[i]; // middle third
-			for(; i<116; i++) midD_stops += histogram_stats[i]; 
-			for(; i<128; i++) clipped += histogram_stats[i];  // clipped bright blue sky is luma around 240-242
-			top_stops = midC_stops + midD_stops + clipped; // 0 to 170, top third
-			twothirds = (bot_stops+midA_stops+midB_stops);
+			int total = HIST_TOTAL(ycdf); // total pixels sampled.  
+			int bot_stops = HIST_COUNT(ycdf, 0, 42);    // bottom third
+			int midA_stops = HIST_COUNT(ycdf, 42, 64);  // middle third
+			int midB_stops = HIST_COUNT(ycdf, 64, 85);  // middle third
+			int midC_stops = HIST_COUNT(ycdf, 85, 96);  // middle third
+			int midD_stops = HIST_COUNT(ycdf, 96, 116);
+			int clipped = HIST_COUNT(ycdf, 116, 128);   // clipped bright blue sky is luma around 240-242
 
             int maxexpo = 8250 * power;
             if(*enc_frames == 0)
                 maxexpo = 33000; // in preview don't limit the gain.
                 
-			if((midD_stops + clipped + bot_stops)*16 < midA_stops + midB_stops + midC_stops) // low contrast negative, have a peak in the middle.
+            int fast = ae_state[3] > 0;
+            if(fast) ae_state[3]--;
+            
+            if(ae_state[2] > 0)
+            {
+                ae_state[2]--;   // waiting for the last jump to show up
+#if SPARSE_SAMPLING
+                *MM(uint32_t *, SCRATCH_HIST_ACCUM) = 0;
+#endif
+            }
+			else if((midD_stops + clipped + bot_stops)*16 < midA_stops + midB_stops + midC_stops) // low contrast negative, have a peak in the middle.
 			{
 				// no change
 			}
-			else if(clipped > (total>>7))
-			{
-				//maybe clipping
-				newexpo = (currexpo * 15984)>>14;   // decrease by 1.025
-				if(newexpo > 750)
-					nextexpo = newexpo; 
-			}
-			else if(top_stops > twothirds)
-			{
-				//maybe overexposed
-				newexpo = (currexpo * 16222)>>14;   // decrease by 1.01
-				if(newexpo > 750)
-					nextexpo = newexpo; 
-			}
-			else if(top_stops < (total>>8)) // almost no data in the last ~1 stop
+			else if(currexpo > 0 && total > 0)
 			{
-				// underexposed 
-				newexpo = (currexpo * 16794)>>14;  // increase slightly 1.025x
-				if(newexpo < maxexpo)// keep exposure less than 8ms at ISO 400
-					nextexpo = newexpo;
+                int bin;
+                HIST_TOP_PCT(ycdf, total>>AE_PCT_SHIFT, bin);   // highlight percentile
+                
+                int plog, tlog, err;
+                LOG2_Q8(bin*2+1, plog);             // bins are 2 levels wide
+                LOG2_Q8(AE_TARGET_LUMA, tlog);
+                err = ((tlog - plog) * AE_GAMMA_Q8) >> 8;
+                if(bin >= AE_CLIP_BIN && err > -AE_CLIP_STEP)
+                    err = -AE_CLIP_STEP;            // clipped, the real level is unknown
+                
+                int aerr = err < 0 ? -err : err;
+                if(aerr >= AE_WAKE) ae_state[1] = 1;
+                if(aerr < AE_HOLD) ae_state[1] = 0;
+                
+                if(ae_state[1])
+                {
+                    int step = aerr > AE_FINE ? (fast ? err : (err*3)>>2) : err>>1;
+                    if(step > AE_MAX_STEP) step = AE_MAX_STEP;
+                    if(step < -AE_MAX_STEP) step = -AE_MAX_STEP;
+                    EXP2_SCALE_Q8(currexpo, step, newexpo);
+                    
+                    if(step < 0 && newexpo < 750)
+                        newexpo = currexpo < 750 ? currexpo : 750;
+                    if(step > 0 && newexpo > maxexpo) // keep exposure less than 8ms at ISO 400
+                        newexpo = currexpo > maxexpo ? currexpo : maxexpo;
+                    nextexpo = newexpo;
+                    
+                    if(aerr > AE_FINE)
+                        ae_state[2] = AE_SETTLE;
+#if SPARSE_SAMPLING
+                    *MM(uint32_t *, SCRATCH_HIST_ACCUM) = 0;  // next frame starts a fresh history
+#endif
+                }
 			}
             
 			{
@@ -988,11 +1694,176 @@ void calc_histogram(void)
 		}
 	}
 #endif
+
+#if AWB
+    PHASE(awb);
+    {
+        uint32_t *awb = MM(uint32_t *, SCRATCH_AWB); // tag, r, g, b, r and b << AWB_RATE
+        uint32_t total = HIST_TOTAL(ycdf);
+        int m[3], c, clipped = 0, dark = 0;
+        
+        for (c = 0; c < 3; c++) {
+            HIST_TOP_PCT(HIST_CDF(hist_cdf, c+1), total>>AWB_PCT_SHIFT, m[c]);
+            if(m[c] >= AWB_CLIP_BIN) clipped = 1;
+            if(m[c] < AWB_DARK_BIN) dark = 1;
+        }
+        if(clipped && total > 0)
+            for (c = 0; c < 3; c++)
+                m[c] = HIST_WSUM(hist_cdf, c+1) / total;
+        
+        if(total > 0 && !dark && wb_gains[0] && wb_gains[1] && wb_gains[2])
+        {
+            int fresh = awb[0] != AWB_TAG;
+            for (c = 0; c < 3; c += 2) {
+                int t;
+                WB_NEUTRAL_GAIN(wb_gains[c], wb_gains[1], m[c]*2+1, m[1]*2+1, t);
+                uint32_t a = fresh ? (uint32_t)t << AWB_RATE : awb[4+c/2] - (awb[4+c/2] >> AWB_RATE) + t;
+                awb[4+c/2] = a;
+                awb[1+c] = a >> AWB_RATE;
+            }
+            awb[2] = 256;
+            awb[0] = AWB_TAG;
+        }
+    }
+#endif
+
+#if FILM_PROFILE
+    PHASE(calibrate);
+    {
+        uint32_t *cal = MM(uint32_t *, SCRATCH_CALIB); // tag, frames, R, G, B sums of Q4 mean bins
+        uint32_t total = HIST_TOTAL(ycdf);
+        int mode = (nvm_base[NVM_WB_MODS] & WB_MODS_MODE) >> WB_MODS_MODE_SHIFT;
+        
+        if(mode != WB_MODE_CALIBRATE)
+        {
+            cal[0] = 0;
+        }
+        else if(total > 0 && wb_gains[0] && wb_gains[1] && wb_gains[2])
+        {
+            uint32_t *gcdf = HIST_CDF(hist_cdf, 2);
+            int lo, hi, c;
+            if(cal[0] != CALIB_TAG)
+            {
+                cal[1] = cal[2] = cal[3] = cal[4] = 0;
+                cal[0] = CALIB_TAG;
+            }
+            HIST_TOP_PCT(gcdf, total - total/10, lo);
+            HIST_TOP_PCT(gcdf, total/10, hi);
+            if(hi - lo <= CALIB_FLAT_BINS && cal[1]++ >= CALIB_SKIP)
+                for (c = 0; c < 3; c++)
+                    cal[2+c] += (HIST_WSUM(hist_cdf, c+1) << 4) / total;
+            
+            if(cal[1] == CALIB_SKIP + (1 << CALIB_FRAMES_SHIFT))
+            {
+                // mean levels in 1/16ths, (bin*2+1)*16
+                int l[3], ok = 1;
+                for (c = 0; c < 3; c++) {
+                    l[c] = ((cal[2+c] * 2) >> CALIB_FRAMES_SHIFT) + 16;
+                    if(l[c] < AWB_DARK_BIN*32 || l[c] >= AWB_CLIP_BIN*32) ok = 0;
+                }
+                if(ok)
+                {
+                    int gr, gb;
+                    WB_NEUTRAL_GAIN(wb_gains[0], wb_gains[1], l[0], l[1], gr);
+                    WB_NEUTRAL_GAIN(wb_gains[2], wb_gains[1], l[2], l[1], gb);
+                    nvm_base[NVM_PROFILE_GAINS] = gr | gb << 12;
+                    nvm_base[NVM_PROFILE_BASE] = ((l[1] + 8) >> 4) | NVM_PROFILE_TAG << 24;
+                }
+                mode = ok ? WB_MODE_PROFILE : WB_MODE_PRESET;
+                nvm_base[NVM_WB_MODS] = (nvm_base[NVM_WB_MODS] & ~WB_MODS_MODE) | mode << WB_MODS_MODE_SHIFT;
+                cal[0] = 0;
+            }
+        }
+    }
+#endif
+
+#if PROFILE
+    PHASE(profile);
+    PROF_MARK(PROF_HIST);
+    {
+        uint32_t *prof = MM(uint32_t *, SCRATCH_PROFILE); // tag, frameno, count
+        PROF_INIT(prof);
+        for (int e = PROF_SAMPLE; e < PROF_HIST; e++)
+        {
+            if(prof_acc[e])
+                PROF_UPDATE(prof, e, prof_acc[e]);
+            else
+                PROF_ENTRY(prof, e)[PROF_LAST] = 0;  // compiled out
+        }
+        PROF_UPDATE(prof, PROF_HIST, prof_last - prof_t0);
+        if(prof[1] + 1 == (uint32_t)*frameno)
+            PROF_UPDATE(prof, PROF_PERIOD, prof_t0 - prof[2]);
+        else
+            PROF_ENTRY(prof, PROF_PERIOD)[PROF_LAST] = 0;  // a frame was skipped
+        prof[1] = *frameno;
+        prof[2] = prof_t0;
+    }
+#endif
+
+#if TELEMETRY
+    PHASE(telemetry);
+    {
+        uint32_t *tlm = MM(uint32_t *, SCRATCH_TELEMETRY); // tag, head, tail
+        if(tlm[0] != TLM_TAG)
+        {
+            tlm[1] = 0;
+            tlm[2] = 0;
+            tlm[0] = TLM_TAG;
+        }
+        uint32_t n = tlm[1];
+        uint8_t *rec = (uint8_t *)tlm + TLM_HEADER + (n & (TLM_RECORDS-1)) * TLM_RECORD;
+        uint16_t *wb16 = (uint16_t *)&rec[TLM_WB];
+        uint8_t *pct = &rec[TLM_Y_PCT];
+        uint32_t total = HIST_TOTAL(ycdf);
+        int b;
+        
+        *(uint32_t *)&rec[TLM_SEQ] = TLM_SEQ_BUSY;
+        COMPILER_BARRIER();
+        *(uint32_t *)&rec[TLM_FRAMENO] = *frameno;
+        *(uint32_t *)&rec[TLM_ENC_FRAMES] = *enc_frames;
+        *(uint16_t *)&rec[TLM_ISO] = tlm_iso;
+        *(uint16_t *)&rec[TLM_EXPO_TIME] = tlm_time;
+        wb16[0] = wb_gains[0];
+        wb16[1] = wb_gains[1];
+        wb16[2] = wb_gains[2];
+        rec[TLM_QP] = current_Qp[0];
+        rec[TLM_EV_BIAS] = nvm_base[NVM_EVBIAS];
+        HIST_TOP_PCT(ycdf, total - (total>>7), b); pct[0] = b;   // 1%
+        HIST_TOP_PCT(ycdf, total - total/10, b);   pct[1] = b;   // 10%
+        HIST_TOP_PCT(ycdf, total>>1, b);           pct[2] = b;   // 50%
+        HIST_TOP_PCT(ycdf, total/10, b);           pct[3] = b;   // 90%
+        HIST_TOP_PCT(ycdf, total>>7, b);           pct[4] = b;   // 99%
+        rec[TLM_Y_MEAN] = total ? (2*HIST_WSUM(hist_cdf,0) + total) / total : 0;
+        rec[TLM_FLAGS] = (*enc_frames > 0 ? TLM_F_ENCODE : 0) |
+                         (ae_state[1] ? TLM_F_CORRECTING : 0) |
+                         (ae_state[2] ? TLM_F_SETTLING : 0) |
+                         (*expo_iso != tlm_iso || *expo_time != tlm_time ? TLM_F_EXPO_CHANGED : 0);
+        rec[TLM_SLOT] = current_frame;
+#if WEAVE
+        // this frame's weave estimate, under the same record number
+        uint32_t *wv = MM(uint32_t *, SCRATCH_WEAVE);
+        uint32_t *wl = MM(uint32_t *, SCRATCH_WEAVE_LOG) + (n & (TLM_RECORDS-1)) * (WEAVE_LOG_ENTRY/4);
+        wl[WEAVE_LOG_SEQ/4] = TLM_SEQ_BUSY;
+        COMPILER_BARRIER();
+        wl[WEAVE_LOG_FRAMENO/4] = *frameno;
+        wl[WEAVE_LOG_DXDY/4] = wv[WEAVE_PUB_DXDY];
+        wl[WEAVE_LOG_CONF/4] = wv[WEAVE_PUB_CONF];
+        COMPILER_BARRIER();
+        wl[WEAVE_LOG_SEQ/4] = n;
+#endif
+        COMPILER_BARRIER();
+        *(uint32_t *)&rec[TLM_SEQ] = n;
+        COMPILER_BARRIER();
+        tlm[1] = n + 1;
+    }
+#endif
 	return;
 }
 
+#ifndef REELS_HARNESS
 int main(void)
 {
     calc_histogram();
     return 0;
 }
+#endif
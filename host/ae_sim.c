@@ -0,0 +1,310 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * ae_sim [-p|-e] [-l latency] [-t tolerance] [-v] [script]
+ *
+ * Closed loop test of the auto exposure in calc_histogram() without film.
+ * Each frame is rendered from a model of the scanner, handed to the hook
+ * through the preview or encode ring, and the exposure the hook leaves in
+ * expo_iso/expo_time is what the sensor uses latency frames later:
+ *
+ *   film       transmittance 10^-density over a fixed test image whose
+ *              reflectance spans ~5 stops with some pure highlights
+ *   sensor     signal = transmittance * reflectance * expo_time*(iso/50)
+ *              / SENSOR_FULL, clipped at 1
+ *   ISP        8-bit luma = 255 * signal^(1/2.2), neutral chroma
+ *
+ * The script is one segment per line, "frames density [fade]": density is
+ * held for the segment, jumping to it at the start (a splice) or, with
+ * fade, ramping to it from the previous density over the segment.  Without
+ * a script a built in reel of leader, splices and fades is used.
+ *
+ * For every segment after the first it reports, from the exposures the
+ * sensor actually used:
+ *   converge   frames from the start of the segment until the exposure
+ *              stays within tolerance stops of where the segment ends, for
+ *              at least STABLE_FRAMES, "-" if it never does.  A fade is
+ *              measured together with a hold at its density that follows
+ *              it, from the end of the fade.
+ *   overshoot  stops past that final exposure in the direction it moved
+ *   reversals  changes of direction of the exposure steps
+ * for the preview branch and the encode branch (-p, -e for only one).
+ *   -l  frames between the hook writing an exposure and a frame taken
+ *       with it, default 2
+ *   -t  convergence tolerance in stops, default 0.1
+ *   -v  also print every frame: frame, density, iso, time, mean luma
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "host.h"
+
+#define SENSOR_FULL     1000.0  // expo_time*(iso/50) that clips clear film at reflectance 1
+#define MAX_SEGMENTS    256
+#define MAX_LATENCY     8
+#define STABLE_FRAMES   5
+
+typedef struct {
+    int frames;
+    double density;
+    int fade;
+} segment_t;
+
+static const segment_t default_reel[] = {
+    { 30, 0.05, 0 },    // clear leader
+    { 60, 0.90, 0 },    // splice into the first scene
+    { 60, 1.50, 0 },    // splice, 2 stops denser
+    { 60, 0.60, 0 },    // splice, 3 stops lighter
+    { 40, 2.10, 1 },    // fade out
+    { 20, 2.10, 0 },
+    { 40, 0.90, 1 },    // fade in
+    { 30, 0.90, 0 },
+    { 60, 0.30, 0 },    // overexposed scene
+    { 40, 0.05, 0 },    // trailer leader
+};
+
+static int load_script(const char *path, segment_t *seg)
+{
+    FILE *fp = fopen(path, "r");
+    char line[256], word[16];
+    int n = 0, ln = 0;
+
+    if(fp == 0)
+    {
+        perror(path);
+        return 0;
+    }
+    while(fgets(line, sizeof(line), fp))
+    {
+        char *hash = strchr(line, '#');
+        int fields;
+
+        ln++;
+        if(hash)
+            *hash = 0;
+        word[0] = 0;
+        fields = sscanf(line, "%d %lf %15s", &seg[n].frames, &seg[n].density, word);
+        if(fields <= 0)
+            continue;
+        if(fields < 2 || seg[n].frames < 1 || (fields == 3 && strcmp(word, "fade")) || n == MAX_SEGMENTS)
+        {
+            fprintf(stderr, "%s:%d: expected: frames density [fade]\n", path, ln);
+            fclose(fp);
+            return 0;
+        }
+        seg[n++].fade = fields == 3;
+    }
+    fclose(fp);
+    if(n == 0)
+        fprintf(stderr, "%s: no segments\n", path);
+    return n;
+}
+
+// Fixed test image: reflectance 0.03..1, a gradient broken up so every
+// level is spread over the frame, and a bright patch that clips first
+static void build_scene(float *refl)
+{
+    int x, y;
+
+    for(y=0; y<HOST_HEIGHT; y++)
+    {
+        for(x=0; x<HOST_WIDTH; x++)
+        {
+            double s = ((x*7 + y*13) % 97) / 96.0;
+            if(x > 520 && x < 580 && y > 100 && y < 160)
+                s = 1.0;
+            refl[y*HOST_WIDTH + x] = (float)(0.03 + 0.97 * s * s);
+        }
+    }
+}
+
+static double render(uint8_t *frame, const float *refl, const uint8_t *gamma, double gain)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for(i=0; i<HOST_WIDTH*HOST_HEIGHT; i++)
+    {
+        double s = refl[i] * gain;
+        frame[i] = gamma[s >= 1.0 ? 4095 : (int)(s * 4095.0)];
+        sum += frame[i];
+    }
+    memset(frame + HOST_CHROMA, 128, HOST_WIDTH*HOST_HEIGHT/2);
+    return (double)sum / (HOST_WIDTH*HOST_HEIGHT);
+}
+
+// Run one branch over the script, exposures[frame] = what the sensor used
+static void run(int encode, const segment_t *seg, int nseg, int latency, int verbose,
+                const float *refl, const uint8_t *gamma, double *exposures)
+{
+    uint8_t *frame = calloc(1, RING_STRIDE);
+    uint32_t ring = encode ? ADDR_RING_ENCODE : ADDR_RING_PREVIEW;
+    double applied[MAX_LATENCY], density = seg[0].density;
+    int *expo_iso, i = 0, s, k;
+
+    // Both branches start cold: clear the scratch state the hooks keep
+    // between frames, then seed the firmware variables (and WB gains) again
+    reels_host_init(1);
+    memset(MM(uint8_t *, SCRATCH_EXPO_CHANGE & ~0xffff), 0, 0x10000);
+    reels_host_init(1);
+    *MM(uint32_t *, SCRATCH_EXPO_CHANGE) = encode ? 0 : 0xffff0000;
+    expo_iso = reels_host_expo_iso();
+    for(k=0; k<latency; k++)
+        applied[k] = expo_iso[1] * (expo_iso[0] / 50);
+
+    for(s=0; s<nseg; s++)
+    {
+        double from = density;
+        for(k=0; k<seg[s].frames; k++, i++)
+        {
+            double luma;
+
+            density = seg[s].fade ? from + (seg[s].density - from) * (k + 1) / seg[s].frames : seg[s].density;
+            exposures[i] = applied[0];
+            luma = render(frame, refl, gamma, pow(10.0, -density) * applied[0] / SENSOR_FULL);
+
+            reels_host_put_frame(ring, i % RING_FRAMES, frame);
+            *MM(int *, ADDR_FRAMENO) = 100 + i;
+            *MM(uint32_t *, SCRATCH_ENC_FRAMES) = encode ? i + 1 : 0;
+            calc_histogram();
+
+            if(verbose)
+                printf("%s,%d,%.3f,%d,%d,%.1f\n", encode ? "encode" : "preview", i, density,
+                       expo_iso[0], expo_iso[1], luma);
+            memmove(applied, applied + 1, sizeof(double) * (latency - 1));
+            applied[latency - 1] = expo_iso[1] * (expo_iso[0] / 50);
+        }
+    }
+    free(frame);
+}
+
+static void report(const char *name, const segment_t *seg, int nseg, const double *exposures, double tol)
+{
+    int s, start = seg[0].frames;
+
+    printf("%s\n  seg  frames  density        converge  overshoot  reversals\n", name);
+    for(s=1; s<nseg; s++)
+    {
+        int n = seg[s].frames, k, stable, reversals = 0, last_dir = 0, first = s;
+        int from = seg[s].fade ? n : 0;  // a fade only settles once it stops
+        const double *e = exposures + start;
+        double final, moved, over = 0;
+
+        if(seg[s].fade && s+1 < nseg && !seg[s+1].fade && seg[s+1].density == seg[s].density)
+            n += seg[++s].frames;
+        final = e[n-1];
+        moved = log2(final / exposures[start-1]);
+
+        for(k=n-1; k>=0 && fabs(log2(e[k] / final)) <= tol; k--)
+            ;
+        stable = k + 1;
+        for(k=0; k<n; k++)
+        {
+            double past = moved >= 0 ? log2(e[k] / final) : log2(final / e[k]);
+            int dir = k == 0 ? 0 : e[k] > e[k-1] ? 1 : e[k] < e[k-1] ? -1 : 0;
+            if(past > over)
+                over = past;
+            if(dir && last_dir && dir != last_dir)
+                reversals++;
+            if(dir)
+                last_dir = dir;
+        }
+        printf("  %3d  %6d  %5.2f%-5s  ", first, n, seg[first].density, seg[first].fade ? " fade" : "");
+        if(n - stable < STABLE_FRAMES)
+            printf("%10s", "-");
+        else
+            printf("%10d", stable > from ? stable - from : 0);
+        printf("  %7.2f EV  %9d\n", over, reversals);
+        start += n;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int branches = 3, latency = 2, verbose = 0, nseg, total = 0, i;
+    double tol = 0.1;
+    const char *script = 0;
+    static segment_t seg[MAX_SEGMENTS];
+    uint8_t gamma[4096];
+    float *refl;
+    double *exposures;
+
+    for(i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "-p") == 0)
+            branches = 1;
+        else if(strcmp(argv[i], "-e") == 0)
+            branches = 2;
+        else if(strcmp(argv[i], "-l") == 0 && i+1 < argc)
+            latency = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-t") == 0 && i+1 < argc)
+            tol = atof(argv[++i]);
+        else if(strcmp(argv[i], "-v") == 0)
+            verbose = 1;
+        else if(argv[i][0] != '-' && !script)
+            script = argv[i];
+        else
+            latency = -1;
+    }
+    if(latency < 1 || latency > MAX_LATENCY || tol <= 0)
+    {
+        fprintf(stderr, "usage: ae_sim [-p|-e] [-l 1..%d] [-t stops] [-v] [script]\n", MAX_LATENCY);
+        return 1;
+    }
+
+    if(script)
+    {
+        nseg = load_script(script, seg);
+        if(nseg == 0)
+            return 1;
+    }
+    else
+    {
+        nseg = sizeof(default_reel) / sizeof(default_reel[0]);
+        memcpy(seg, default_reel, sizeof(default_reel));
+    }
+    for(i=0; i<nseg; i++)
+        total += seg[i].frames;
+
+    for(i=0; i<4096; i++)
+        gamma[i] = (uint8_t)(255.0 * pow(i / 4095.0, 1 / 2.2) + 0.5);
+    refl = malloc(sizeof(float) * HOST_WIDTH * HOST_HEIGHT);
+    exposures = malloc(sizeof(double) * total);
+    build_scene(refl);
+
+    if(verbose)
+        printf("branch,frame,density,iso,time,luma\n");
+    for(i=1; i<=2; i++)
+    {
+        if(!(branches & i))
+            continue;
+        run(i == 2, seg, nseg, latency, verbose, refl, gamma, exposures);
+        report(i == 2 ? "encode" : "preview", seg, nseg, exposures, tol);
+    }
+    free(refl);
+    free(exposures);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host side of the fake address space used by libreels.a (x86-64) and by
+ * the qemu-mipsel driver in host/qemu.
+ */
+
+#ifndef REELS_HOST_H
+#define REELS_HOST_H
+
+#include <stdint.h>
+#include "memmap.h"
+
+#define HOST_WIDTH   656
+#define HOST_HEIGHT  480
+#define HOST_CHROMA  (HOST_WIDTH*HOST_HEIGHT + 0x18600)  // NV12 UV plane offset within a ring frame
+
+// Names of the SCRATCH_PROFILE entries, in PROF_* order (memmap.h)
+#define PROF_NAMES { "sample", "draw", "text", "composite", "ae", "weave", \
+                     "calc_histogram", "select_wb", "frame period" }
+
+// The hooks, as built from hist/ and manwb/
+void calc_histogram(void);
+void select_wb(void);
+
+// Map the 128MB fake DRAM and seed the firmware state the hooks expect.
+// reel_type is 1, 2 or 3.  Returns 0 on success.
+int reels_host_init(int reel_type);
+
+// Host pointers to the per-type firmware variables
+int32_t *reels_host_nvm(void);
+int *reels_host_expo_iso(void);
+
+// Copy one NV12 frame (RING_STRIDE bytes) into slot 0..5 of the ring at
+// ring_addr and mark it as the frame just written by the ISP, with the ISP
+// already started on the next slot, so it is the last completed frame.
+void reels_host_put_frame(uint32_t ring_addr, int slot, const uint8_t *frame);
+
+// Fill a frame with a deterministic test pattern (when no dump is given)
+void reels_host_synth_frame(uint8_t *frame, int seed);
+
+// Read a file of back-to-back RING_STRIDE frames.  Returns the frame count,
+// *frames is malloc'd.
+int reels_host_load_frames(const char *path, uint8_t **frames);
+
+#endif
@@ -0,0 +1,220 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * host_bench [-e] [-c] [-n frames] [-t type] [dump ...]
+ *
+ * Feeds recorded NV12 ring dumps (back-to-back 0x97e00 byte frames, as read
+ * from 0xa2730b70 or 0xa37AB770) through calc_histogram() and reports the
+ * time per frame.  With no dump a synthetic pattern is used.  The hooks'
+ * own CP0 Count profile (SCRATCH_PROFILE, ns on the host) is printed too.
+ *   -e  encode mode (enc_frames counting), default is preview
+ *   -c  overlay check: once, 2 x OVERLAY_REFRESH calls before the end, clear
+ *       the overlay buffer except its 0x55 border bytes, as the firmware
+ *       might, and fail unless the overlay at the end is the same as that of
+ *       a forked copy of the run that did not clear it
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "host.h"
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, uint64_t *ns, int n)
+{
+    uint64_t total = 0;
+    int i;
+
+    for(i=0; i<n; i++) total += ns[i];
+    qsort(ns, n, sizeof(*ns), cmp_u64);
+    printf("%-15s %6d calls  min %8llu  median %8llu  mean %8llu ns/frame\n", name, n,
+           (unsigned long long)ns[0], (unsigned long long)ns[n/2],
+           (unsigned long long)(total / n));
+}
+
+static void report_profile(void)
+{
+    static const char *names[PROF_ENTRIES] = PROF_NAMES;
+    uint32_t *prof = MM(uint32_t *, SCRATCH_PROFILE);
+    int e;
+
+    if(prof[0] != PROF_TAG)
+        return;
+    printf("SCRATCH_PROFILE\n");
+    for(e=0; e<PROF_ENTRIES; e++)
+    {
+        uint32_t *p = PROF_ENTRY(prof, e);
+        if(p[PROF_MAX] == 0)
+            continue;
+        printf("  %-15s min %8u  avg %8u  max %8u ns\n", names[e],
+               p[PROF_MIN], p[PROF_AVG] >> PROF_AVG_SHIFT, p[PROF_MAX]);
+    }
+}
+
+// The overlay buffer calc_histogram drew last, from SCRATCH_OVERLAY_STATE
+static uint8_t *find_overlay(void)
+{
+    static const uint32_t addr[5] = {
+        ADDR_OVERLAY0, ADDR_OVERLAY1, ADDR_OVERLAY2, ADDR_OVERLAY3, ADDR_OVERLAY4
+    };
+    uint32_t owner = *MM(uint32_t *, SCRATCH_OVERLAY_STATE);
+    int k;
+
+    for(k=0; k<5; k++)
+    {
+        uint8_t *base = MM(uint8_t *, addr[k]);
+        uint32_t off = owner - (uint32_t)(uintptr_t)base;
+        if(off == 0 || off == 4)
+            return base + off;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int encode = 0, check = 0, clear_at = -1, twin = -1, fd[2] = { -1, -1 }, iterations = 1000, reel_type = 1;
+    int nframes = 0, i;
+    uint8_t *frames = 0;
+
+    for(i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "-e") == 0)
+            encode = 1;
+        else if(strcmp(argv[i], "-c") == 0)
+            check = 1;
+        else if(strcmp(argv[i], "-n") == 0 && i+1 < argc)
+            iterations = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-t") == 0 && i+1 < argc)
+            reel_type = atoi(argv[++i]);
+        else
+        {
+            uint8_t *more;
+            int count = reels_host_load_frames(argv[i], &more);
+            if(count == 0)
+                return 1;
+            frames = realloc(frames, (size_t)(nframes + count) * RING_STRIDE);
+            memcpy(frames + (size_t)nframes * RING_STRIDE, more, (size_t)count * RING_STRIDE);
+            nframes += count;
+            free(more);
+        }
+    }
+    if(iterations < 1 || reel_type < 1 || reel_type > 3)
+    {
+        fprintf(stderr, "usage: host_bench [-e] [-c] [-n frames] [-t 1|2|3] [dump ...]\n");
+        return 1;
+    }
+    if(reels_host_init(reel_type))
+        return 1;
+
+    if(nframes == 0)
+    {
+        nframes = RING_FRAMES;
+        frames = malloc((size_t)nframes * RING_STRIDE);
+        memset(frames, 0, (size_t)nframes * RING_STRIDE);
+        for(i=0; i<nframes; i++)
+            reels_host_synth_frame(frames + (size_t)i * RING_STRIDE, i);
+    }
+
+    if(check)
+    {
+        clear_at = iterations - 2 * OVERLAY_REFRESH;
+        if(clear_at < RING_FRAMES)  // past the first calls, which lock the ring and pick a buffer
+        {
+            fprintf(stderr, "host_bench: -c needs -n of at least %d\n", 2 * OVERLAY_REFRESH + RING_FRAMES);
+            return 1;
+        }
+    }
+
+    uint32_t ring = encode ? ADDR_RING_ENCODE : ADDR_RING_PREVIEW;
+    uint8_t *overlay = 0, expect[OVERLAY_BYTES];
+    uint64_t *hist_ns = malloc(sizeof(uint64_t) * iterations);
+    uint64_t *wb_ns = malloc(sizeof(uint64_t) * iterations);
+
+    *MM(uint32_t *, SCRATCH_EXPO_CHANGE) = encode ? 0 : 0xffff0000;
+
+    for(i=0; i<iterations; i++)
+    {
+        uint64_t t0, t1, t2;
+
+        reels_host_put_frame(ring, i % RING_FRAMES, frames + (size_t)(i % nframes) * RING_STRIDE);
+        *MM(int *, ADDR_FRAMENO) = 100 + i;
+        *MM(uint32_t *, SCRATCH_ENC_FRAMES) = encode ? i + 1 : 0;
+        *MM(uint8_t *, ADDR_LCD) = 7;  // LCD cleared, status text gets drawn
+
+        t0 = now_ns();
+        select_wb();
+        t1 = now_ns();
+        calc_histogram();
+        t2 = now_ns();
+
+        wb_ns[i] = t1 - t0;
+        hist_ns[i] = t2 - t1;
+
+        // the twin carries on untouched and hands its overlay back at the end
+        if(i == clear_at && (overlay = find_overlay()) != 0 && pipe(fd) == 0 && (twin = fork()) > 0)
+        {
+            for(int b=0; b<OVERLAY_BYTES; b++)
+                if(overlay[b] != 0x55)
+                    overlay[b] = 0;
+        }
+    }
+
+    // the whole overlay fits the pipe, so the twin exits before it is read
+    if(twin == 0)
+        _exit(find_overlay() != overlay || write(fd[1], overlay, OVERLAY_BYTES) != OVERLAY_BYTES);
+
+    printf("%s, %d source frames, reel type %d\n", encode ? "encode" : "preview", nframes, reel_type);
+    report("calc_histogram", hist_ns, iterations);
+    report("select_wb", wb_ns, iterations);
+    report_profile();
+
+    if(check)
+    {
+        int status = 1, ok = twin > 0 && waitpid(twin, &status, 0) == twin && status == 0 &&
+                             read(fd[0], expect, OVERLAY_BYTES) == OVERLAY_BYTES &&
+                             find_overlay() == overlay && memcmp(expect, overlay, OVERLAY_BYTES) == 0;
+        printf("overlay cleared after call %d: %s\n", clear_at, ok ? "redrawn" : "STALE");
+        if(!ok)
+            return 1;
+    }
+
+    free(hist_ns);
+    free(wb_ns);
+    free(frames);
+    return 0;
+}
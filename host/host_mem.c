@@ -0,0 +1,188 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "host.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+#if defined(REELS_QEMU)
+// MM() already points into the fixed window, it only has to be mapped
+uint8_t *reels_host_ram = (uint8_t *)QEMU_RAM_BASE;
+#else
+uint8_t *reels_host_ram = 0;
+#endif
+
+static int host_reel_type = 1;
+
+// CP0_COUNT() off the scanner, in ns
+uint32_t reels_host_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000000000u + (uint32_t)ts.tv_nsec;
+}
+
+int32_t *reels_host_nvm(void)
+{
+    if(host_reel_type == 2) return MM(int32_t *, REEL_B_NVM_BASE);
+    if(host_reel_type == 3) return MM(int32_t *, REEL_C_NVM_BASE);
+    return MM(int32_t *, REEL_A_NVM_BASE);
+}
+
+int *reels_host_expo_iso(void)
+{
+    if(host_reel_type == 2) return MM(int *, REEL_B_EXPO_ISO);
+    if(host_reel_type == 3) return MM(int *, REEL_C_EXPO_ISO);
+    return MM(int *, REEL_A_EXPO_ISO);
+}
+
+int reels_host_init(int reel_type)
+{
+    static int mapped = 0;
+
+    if(!mapped)
+    {
+        // untouched pages stay zero and cost nothing
+#if defined(REELS_QEMU)
+        // never MAP_FIXED, that would silently replace whatever is already
+        // there.  Kernels without NOREPLACE take the address as a hint.
+        void *p = mmap(reels_host_ram, HOST_RAM_SIZE, PROT_READ|PROT_WRITE,
+                       MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_FIXED_NOREPLACE, -1, 0);
+        if(p != MAP_FAILED && p != (void *)reels_host_ram)
+        {
+            fprintf(stderr, "mmap: 0x%08x is in use\n", QEMU_RAM_BASE);
+            munmap(p, HOST_RAM_SIZE);
+            return -1;
+        }
+#else
+        void *p = mmap(0, HOST_RAM_SIZE, PROT_READ|PROT_WRITE,
+                       MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+#endif
+        if(p == MAP_FAILED)
+        {
+            perror("mmap");
+            return -1;
+        }
+        reels_host_ram = (uint8_t *)p;
+        mapped = 1;
+    }
+    host_reel_type = reel_type;
+
+    *MM(int *, ADDR_REEL_TYPE) = reel_type;
+    *MM(int *, ADDR_FRAMENO) = 100;
+
+    int32_t *nvm = reels_host_nvm();
+    nvm[NVM_WBAL] = 4;
+    nvm[NVM_SHARPEN] = 4;
+    nvm[NVM_SAT] = 4;
+    nvm[NVM_FREE] = 1;
+    nvm[NVM_FPS] = 1;
+    nvm[NVM_QPMIN] = 20;
+    nvm[NVM_ISOMAX] = 1;
+    nvm[NVM_NAV] = 3;
+    nvm[NVM_ISO_LOCK] = 100;
+    nvm[NVM_SHUT_LOCK] = 2048;
+
+    int *expo_iso = reels_host_expo_iso();
+    expo_iso[0] = 100;
+    expo_iso[1] = 2047;
+
+    uint32_t *wb_gains = MM(uint32_t *, SCRATCH_WB_GAINS);
+    wb_gains[0] = 0x1D0; wb_gains[1] = 0x100; wb_gains[2] = 0x100;
+
+    uint32_t *window_res = MM(uint32_t *, SCRATCH_WINDOW_RES);
+    window_res[0] = 1440; window_res[1] = 1080;
+    window_res[2] = 512;  window_res[3] = 296;
+
+    *MM(uint32_t *, ADDR_CURRENT_QP) = 25;
+    return 0;
+}
+
+void reels_host_put_frame(uint32_t ring_addr, int slot, const uint8_t *frame)
+{
+    uint8_t *dst = MM(uint8_t *, ring_addr + RING_STRIDE * slot);
+    memcpy(dst, frame, RING_STRIDE);
+    dst = MM(uint8_t *, ring_addr + RING_STRIDE * (slot == RING_FRAMES-1 ? 0 : slot+1));
+    *(uint32_t *)dst = 0x10101010;      // first pixels of the next frame, clearing its stamp
+}
+
+void reels_host_synth_frame(uint8_t *frame, int seed)
+{
+    uint32_t rnd = 0x9e3779b9u * (uint32_t)(seed + 1);
+    int x, y;
+
+    for(y=0; y<HOST_HEIGHT; y++)
+    {
+        for(x=0; x<HOST_WIDTH; x++)
+        {
+            rnd = rnd * 1664525u + 1013904223u;
+            frame[y*HOST_WIDTH + x] = (uint8_t)(16 + ((x + y + seed*4) % 200) + (rnd >> 29));
+        }
+    }
+    for(y=0; y<HOST_HEIGHT/2; y++)
+    {
+        for(x=0; x<HOST_WIDTH; x+=2)
+        {
+            frame[HOST_CHROMA + y*HOST_WIDTH + x]     = (uint8_t)(112 + (x >> 5));
+            frame[HOST_CHROMA + y*HOST_WIDTH + x + 1] = (uint8_t)(144 - (y >> 4));
+        }
+    }
+}
+
+int reels_host_load_frames(const char *path, uint8_t **frames)
+{
+    FILE *fp = fopen(path, "rb");
+    long size;
+    int count;
+
+    *frames = 0;
+    if(fp == 0)
+    {
+        perror(path);
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    count = (int)(size / RING_STRIDE);
+    if(count > 0)
+    {
+        *frames = malloc((size_t)count * RING_STRIDE);
+        if(*frames == 0 || fread(*frames, RING_STRIDE, count, fp) != (size_t)count)
+        {
+            fprintf(stderr, "%s: read failed\n", path);
+            free(*frames);
+            *frames = 0;
+            count = 0;
+        }
+    }
+    fclose(fp);
+    return count;
+}
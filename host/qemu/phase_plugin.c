@@ -0,0 +1,119 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * TCG plugin for qemu_bench.py: counts how often each guest instruction
+ * retires and writes "vaddr count disassembly" lines at exit.
+ *
+ *   qemu-mipsel -plugin ./phase_plugin.so,out=counts.txt ./qemu_driver ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define TABLE_BITS 18
+#define TABLE_SIZE (1u << TABLE_BITS)
+
+typedef struct {
+    uint64_t vaddr;
+    uint64_t count;
+    char *disas;
+} insn_count;
+
+static insn_count *table;
+static const char *out_path = "counts.txt";
+
+static insn_count *lookup(uint64_t vaddr)
+{
+    uint32_t h = (uint32_t)((vaddr >> 2) * 2654435761u) >> (32 - TABLE_BITS);
+
+    while(table[h].disas && table[h].vaddr != vaddr)
+        h = (h + 1) & (TABLE_SIZE - 1);
+    return &table[h];
+}
+
+static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
+{
+    ((insn_count *)udata)->count++;
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    for(i=0; i<n; i++)
+    {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+        uint64_t vaddr = qemu_plugin_insn_vaddr(insn);
+        insn_count *ic = lookup(vaddr);
+
+        if(ic->disas == 0)  // first translation of this pc
+        {
+            ic->vaddr = vaddr;
+            ic->disas = qemu_plugin_insn_disas(insn);
+            if(ic->disas == 0)
+                ic->disas = g_strdup("?");
+        }
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec, QEMU_PLUGIN_CB_NO_REGS, ic);
+    }
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    FILE *fp = fopen(out_path, "w");
+    uint32_t i;
+
+    if(fp == 0)
+        return;
+    for(i=0; i<TABLE_SIZE; i++)
+    {
+        if(table[i].disas && table[i].count)
+            fprintf(fp, "%08llx %llu %s\n", (unsigned long long)table[i].vaddr,
+                    (unsigned long long)table[i].count, table[i].disas);
+    }
+    fclose(fp);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    int i;
+
+    for(i=0; i<argc; i++)
+    {
+        if(strncmp(argv[i], "out=", 4) == 0)
+            out_path = g_strdup(argv[i] + 4);
+    }
+    table = calloc(TABLE_SIZE, sizeof(*table));
+    if(table == 0)
+        return -1;
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
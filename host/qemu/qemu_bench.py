@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+qemu_bench.py
+
+Retired-instruction benchmark of the real -march=mips32 -Os hooks under
+user-mode qemu-mipsel.  Runs qemu_driver once per mode (preview, encode)
+with phase_plugin.so attached, splits the per-pc counts into the sections
+marked with PHASE() in hist.c, and compares against a stored baseline.
+
+usage:
+    python3 qemu_bench.py [--calls 20] [--baseline baseline.txt] [--update]
+                          [--preview frames.bin] [--encode frames.bin]
+
+Estimated cycles use a flat per-instruction cost model (COSTS below) for a
+single-issue MIPS32 core; they are for comparing builds, not absolute timing.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+# Extra cycles on top of 1 per instruction
+COSTS = {
+    "lb": 1, "lbu": 1, "lh": 1, "lhu": 1, "lw": 1, "lwl": 1, "lwr": 1,
+    "mul": 2, "mult": 2, "multu": 2, "madd": 2, "maddu": 2, "msub": 2, "msubu": 2,
+    "div": 34, "divu": 34,
+    "mfhi": 1, "mflo": 1,
+}
+
+FUNCTIONS = ("calc_histogram", "select_wb")
+
+
+def read_symbols(nm, binary):
+    """Return ({function: (start, end)}, [(addr, phase)]) from the driver."""
+    out = subprocess.run([nm, "-S", "-n", binary], check=True,
+                         capture_output=True, text=True).stdout
+    funcs, phases = {}, []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 4 and parts[3] in FUNCTIONS:
+            start = int(parts[0], 16)
+            funcs[parts[3]] = (start, start + int(parts[1], 16))
+        elif len(parts) >= 3 and parts[-1].startswith("__phase_"):
+            name = parts[-1][len("__phase_"):].rsplit("_", 1)[0]
+            phases.append((int(parts[0], 16), name))
+    missing = [f for f in FUNCTIONS if f not in funcs]
+    if missing:
+        sys.exit(f"symbols not found in {binary}: {', '.join(missing)}")
+    return funcs, sorted(phases)
+
+
+def run_mode(args, mode, frames):
+    """Run the driver under qemu, return [(pc, count, mnemonic)]."""
+    with tempfile.NamedTemporaryFile(suffix=".txt", delete=False) as tmp:
+        counts_path = tmp.name
+    cmd = [args.qemu, "-plugin", f"{args.plugin},out={counts_path}",
+           args.driver, "-m", mode, "-c", str(args.calls)] + frames
+    try:
+        subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+        rows = []
+        with open(counts_path) as f:
+            for line in f:
+                parts = line.split(None, 3)
+                if len(parts) < 3:
+                    continue
+                mnemonic = parts[2] if len(parts) == 3 else parts[2].split()[0]
+                rows.append((int(parts[0], 16), int(parts[1]), mnemonic))
+        return rows
+    finally:
+        os.unlink(counts_path)
+
+
+def attribute(rows, funcs, phases, calls):
+    """Sum counts per function/phase, normalised to one call."""
+    result = {}
+    for pc, count, mnemonic in rows:
+        for func, (start, end) in funcs.items():
+            if start <= pc < end:
+                break
+        else:
+            continue
+        phase = "total"
+        if func == "calc_histogram":
+            phase = "setup"
+            for addr, name in phases:
+                if start <= addr <= pc:
+                    phase = name
+        cycles = count * (1 + COSTS.get(mnemonic.split(".")[0], 0))
+        for key in (f"{func}.{phase}", f"{func}.all") if phase != "total" else (f"{func}.all",):
+            insns, cyc = result.get(key, (0, 0))
+            result[key] = (insns + count, cyc + cycles)
+    return {k: (i / calls, c / calls) for k, (i, c) in result.items()}
+
+
+def load_baseline(path):
+    base = {}
+    if os.path.exists(path):
+        with open(path) as f:
+            for line in f:
+                if line.strip() and not line.startswith("#"):
+                    key, insns, cycles = line.split()
+                    base[key] = (float(insns), float(cycles))
+    return base
+
+
+def main() -> None:
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description="Instruction counts of the MIPS hooks under qemu-mipsel.")
+    parser.add_argument("--qemu", default="qemu-mipsel")
+    parser.add_argument("--nm", default="mipsel-linux-gnu-nm")
+    parser.add_argument("--driver", default=os.path.join(here, "qemu_driver"))
+    parser.add_argument("--plugin", default=os.path.join(here, "phase_plugin.so"))
+    parser.add_argument("--calls", type=int, default=20, help="calls per mode (default 20)")
+    parser.add_argument("--preview", action="append", default=[], help="captured preview ring frames")
+    parser.add_argument("--encode", action="append", default=[], help="captured encode ring frames")
+    parser.add_argument("--baseline", default=os.path.join(here, "baseline.txt"))
+    parser.add_argument("--tolerance", type=float, default=0.02,
+                        help="allowed instruction count growth (default 0.02 = 2%%)")
+    parser.add_argument("--update", action="store_true", help="record the results as the new baseline")
+    args = parser.parse_args()
+
+    funcs, phases = read_symbols(args.nm, args.driver)
+    results = {}
+    for mode, frames in (("preview", args.preview), ("encode", args.encode)):
+        for key, value in attribute(run_mode(args, mode, frames), funcs, phases, args.calls).items():
+            results[f"{mode}.{key}"] = value
+
+    base = {} if args.update else load_baseline(args.baseline)
+    if not args.update and not base:
+        sys.exit(f"No baseline at {args.baseline}, record one with 'make qemu-baseline' "
+                 "(the pre-series hooks in ref/) and the same frames")
+    failed = []
+    print(f"{'':40s} {'insns/call':>12s} {'est cycles':>12s} {'baseline':>12s}")
+    for key in sorted(results):
+        insns, cycles = results[key]
+        ref = ""
+        if key in base:
+            ref = f"{base[key][0]:12.0f}"
+            if insns > base[key][0] * (1 + args.tolerance):
+                failed.append(key)
+                ref += "  REGRESSION"
+        elif not args.update:
+            # a phase the baseline hooks did not have, still counted in .all
+            ref = f"{'new':>12s}"
+        print(f"{key:40s} {insns:12.0f} {cycles:12.0f} {ref}")
+
+    if args.update:
+        with open(args.baseline, "w") as f:
+            f.write("# key insns_per_call est_cycles_per_call (qemu_bench.py --update)\n")
+            for key in sorted(results):
+                f.write(f"{key} {results[key][0]:.0f} {results[key][1]:.0f}\n")
+        print(f"Baseline written to {args.baseline}")
+    elif failed:
+        sys.exit(f"{len(failed)} phase(s) over baseline by more than {args.tolerance:.0%}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,106 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * qemu_driver -m preview|encode [-c calls] [-t type] [frames ...]
+ *
+ * Runs the real -Os MIPS32 hist.o / manwb.o under user-mode qemu-mipsel.
+ * The hooks are built with -DREELS_QEMU so their KSEG addresses land in a
+ * window mapped at QEMU_RAM_BASE, which is filled with captured frames
+ * (back-to-back 0x97e00 byte NV12 frames) or a synthetic pattern.  Counting
+ * is done by phase_plugin.so; this just makes the calls.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+
+int main(int argc, char **argv)
+{
+    int encode = -1, calls = 20, reel_type = 1;
+    int nframes = 0, npaths = 0, i;
+    uint8_t *frames = 0;
+    char **paths = calloc(argc, sizeof(char *));
+
+    for(i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "-m") == 0 && i+1 < argc)
+        {
+            i++;
+            encode = strcmp(argv[i], "encode") == 0 ? 1 : strcmp(argv[i], "preview") == 0 ? 0 : -1;
+        }
+        else if(strcmp(argv[i], "-c") == 0 && i+1 < argc)
+            calls = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-t") == 0 && i+1 < argc)
+            reel_type = atoi(argv[++i]);
+        else
+            paths[npaths++] = argv[i];
+    }
+    if(encode < 0 || calls < 1 || reel_type < 1 || reel_type > 3)
+    {
+        fprintf(stderr, "usage: qemu_driver -m preview|encode [-c calls] [-t 1|2|3] [frames ...]\n");
+        return 1;
+    }
+    // Map the window first, qemu-user hands out the same addresses to malloc
+    if(reels_host_init(reel_type))
+        return 1;
+
+    for(i=0; i<npaths; i++)
+    {
+        uint8_t *more;
+        int count = reels_host_load_frames(paths[i], &more);
+        if(count == 0)
+            return 1;
+        frames = realloc(frames, (size_t)(nframes + count) * RING_STRIDE);
+        memcpy(frames + (size_t)nframes * RING_STRIDE, more, (size_t)count * RING_STRIDE);
+        nframes += count;
+        free(more);
+    }
+    free(paths);
+
+    if(nframes == 0)
+    {
+        nframes = RING_FRAMES;
+        frames = calloc(nframes, RING_STRIDE);
+        for(i=0; i<nframes; i++)
+            reels_host_synth_frame(frames + (size_t)i * RING_STRIDE, i);
+    }
+
+    uint32_t ring = encode ? ADDR_RING_ENCODE : ADDR_RING_PREVIEW;
+    *MM(uint32_t *, SCRATCH_EXPO_CHANGE) = encode ? 0 : 0xffff0000;
+
+    for(i=0; i<calls; i++)
+    {
+        reels_host_put_frame(ring, i % RING_FRAMES, frames + (size_t)(i % nframes) * RING_STRIDE);
+        *MM(int *, ADDR_FRAMENO) = 100 + i;
+        *MM(uint32_t *, SCRATCH_ENC_FRAMES) = encode ? i + 1 : 0;
+        *MM(uint8_t *, ADDR_LCD) = 7;  // LCD cleared, status text gets drawn
+
+        select_wb();
+        calc_histogram();
+    }
+
+    printf("%s: %d calls over %d frames\n", encode ? "encode" : "preview", calls, nframes);
+    free(frames);
+    return 0;
+}
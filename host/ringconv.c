@@ -0,0 +1,352 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * ringconv [-j threads] [-o offset] [-f first] [-n count] [-s slot] [-r fps]
+ *          dump.bin out.y4m|-
+ * ringconv -p prefix [-z level] [...] dump.bin
+ *
+ * Converts dumps of the NV12 frame rings (back-to-back 0x97e00 byte frames,
+ * luma at 0, interleaved UV at WIDTH*HEIGHT + 0x18600, as calc_histogram
+ * reads them) into one Y4M stream or into prefix0001.png, prefix0002.png...
+ * The dump is mapped, not read, and frames are converted on every core: for
+ * Y4M a batch of frames is converted while the previous one is written out
+ * in order, PNGs are converted, deflated and written by whichever thread
+ * picks the frame.
+ *   -o  bytes to skip at the start of the dump (a RAM dump from 0xa2730b70
+ *       or 0xa37AB770 has none)
+ *   -s  ring slot to start each group of six frames at, so a snapshot of a
+ *       whole ring plays oldest first (the slot after the one being written)
+ *   -r  frame rate written to the Y4M header, num or num:den, default 24
+ * PNGs are RGB with the same integer BT.709 full range conversion the
+ * histogram uses, chroma nearest neighbour.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "host.h"
+
+#define Y4M_FRAME   (6 + HOST_WIDTH*HOST_HEIGHT*3/2)
+#define PNG_ROW     (1 + HOST_WIDTH*3)
+#define BATCH       8           // Y4M frames per thread per batch
+
+typedef struct {
+    const uint8_t *dump;        // first frame
+    long nframes, first, count;
+    int slot, level;
+    const char *prefix;
+
+    long next, end;             // frames handed out, end of the current pass
+    uint8_t *out;               // Y4M batch being filled
+    long out_base;
+    int failed;
+} conv_t;
+
+// Frame of the dump shown as output frame j
+static const uint8_t *source_frame(const conv_t *cv, long j)
+{
+    long f = cv->first + j;
+
+    if(cv->slot && f - f % RING_FRAMES + RING_FRAMES <= cv->nframes)
+        f = f - f % RING_FRAMES + (f % RING_FRAMES + cv->slot) % RING_FRAMES;
+    return cv->dump + (size_t)f * RING_STRIDE;
+}
+
+static void to_y4m(const uint8_t *src, uint8_t *dst)
+{
+    const uint8_t *uv = src + HOST_CHROMA;
+    uint8_t *u = dst + 6 + HOST_WIDTH*HOST_HEIGHT, *v = u + HOST_WIDTH*HOST_HEIGHT/4;
+    int i;
+
+    memcpy(dst, "FRAME\n", 6);
+    memcpy(dst + 6, src, HOST_WIDTH*HOST_HEIGHT);
+    for(i = 0; i < HOST_WIDTH*HOST_HEIGHT/4; i++)
+    {
+        u[i] = uv[2*i];
+        v[i] = uv[2*i+1];
+    }
+}
+
+static uint8_t clamp255(int x)
+{
+    return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+static void to_rgb(const uint8_t *src, uint8_t *dst)
+{
+    int x, y;
+
+    for(y = 0; y < HOST_HEIGHT; y++)
+    {
+        const uint8_t *luma = src + y*HOST_WIDTH;
+        const uint8_t *uv = src + HOST_CHROMA + (y>>1)*HOST_WIDTH;
+        uint8_t *row = dst + y*PNG_ROW;
+
+        *row++ = 0;  // filter: none
+        for(x = 0; x < HOST_WIDTH; x++)
+        {
+            int yy = luma[x], u = uv[x & ~1] - 128, v = uv[(x & ~1) + 1] - 128;
+            *row++ = clamp255(yy + (1616 * v >> 10));
+            *row++ = clamp255(yy - (192 * u >> 10) - (479 * v >> 10));
+            *row++ = clamp255(yy + (1899 * u >> 10));
+        }
+    }
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static int write_chunk(FILE *fp, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t head[8], tail[4];
+    uint32_t crc = crc32(0, (const Bytef *)type, 4);
+
+    if(len)  // crc32() restarts on a NULL buffer
+        crc = crc32(crc, data, len);
+
+    put_be32(head, len);
+    memcpy(head + 4, type, 4);
+    put_be32(tail, crc);
+    return fwrite(head, 1, 8, fp) == 8 && fwrite(data, 1, len, fp) == len && fwrite(tail, 1, 4, fp) == 4;
+}
+
+static int write_png(const char *path, const uint8_t *rgb, uint8_t *zbuf, uLongf zlen, int level)
+{
+    static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    uint8_t ihdr[13] = { 0 };
+    FILE *fp;
+    int ok;
+
+    if(compress2(zbuf, &zlen, rgb, PNG_ROW * HOST_HEIGHT, level) != Z_OK)
+        return 0;
+    put_be32(ihdr, HOST_WIDTH);
+    put_be32(ihdr + 4, HOST_HEIGHT);
+    ihdr[8] = 8;    // bits per channel
+    ihdr[9] = 2;    // RGB
+    fp = fopen(path, "wb");
+    if(!fp)
+        return 0;
+    ok = fwrite(sig, 1, 8, fp) == 8 && write_chunk(fp, "IHDR", ihdr, 13) &&
+         write_chunk(fp, "IDAT", zbuf, (uint32_t)zlen) && write_chunk(fp, "IEND", NULL, 0);
+    return fclose(fp) == 0 && ok;
+}
+
+static void *png_worker(void *arg)
+{
+    conv_t *cv = arg;
+    uint8_t *rgb = malloc(PNG_ROW * HOST_HEIGHT);
+    uLongf zlen = compressBound(PNG_ROW * HOST_HEIGHT);
+    uint8_t *zbuf = malloc(zlen);
+    char path[4096];
+    long j;
+
+    while(rgb && zbuf && (j = __atomic_fetch_add(&cv->next, 1, __ATOMIC_RELAXED)) < cv->end)
+    {
+        to_rgb(source_frame(cv, j), rgb);
+        snprintf(path, sizeof(path), "%s%04ld.png", cv->prefix, cv->first + j + 1);
+        if(!write_png(path, rgb, zbuf, zlen, cv->level))
+        {
+            perror(path);
+            cv->failed = 1;
+            break;
+        }
+    }
+    if(!rgb || !zbuf)
+        cv->failed = 1;
+    free(rgb);
+    free(zbuf);
+    return NULL;
+}
+
+static void *y4m_worker(void *arg)
+{
+    conv_t *cv = arg;
+    long j;
+
+    while((j = __atomic_fetch_add(&cv->next, 1, __ATOMIC_RELAXED)) < cv->end)
+        to_y4m(source_frame(cv, j), cv->out + (size_t)(j - cv->out_base) * Y4M_FRAME);
+    return NULL;
+}
+
+static void start_pass(conv_t *cv, pthread_t *tid, int threads, void *(*worker)(void *))
+{
+    int t;
+
+    for(t = 0; t < threads; t++)
+        pthread_create(&tid[t], NULL, worker, cv);
+}
+
+static void finish_pass(pthread_t *tid, int threads)
+{
+    int t;
+
+    for(t = 0; t < threads; t++)
+        pthread_join(tid[t], NULL);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ringconv [-j threads] [-o offset] [-f first] [-n count] [-s slot] [-r fps] dump.bin out.y4m|-\n"
+                    "       ringconv -p prefix [-z level] [-j threads] [-o offset] [-f first] [-n count] [-s slot] dump.bin\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN), opt, fd;
+    unsigned long offset = 0;
+    const char *rate = "24";
+    conv_t cv;
+    struct stat st;
+    pthread_t *tid;
+    void *map;
+
+    memset(&cv, 0, sizeof(cv));
+    cv.count = -1;
+    cv.level = 1;
+    while((opt = getopt(argc, argv, "j:o:f:n:s:r:p:z:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'j': threads = atoi(optarg); break;
+        case 'o': offset = strtoul(optarg, NULL, 0); break;
+        case 'f': cv.first = atol(optarg); break;
+        case 'n': cv.count = atol(optarg); break;
+        case 's': cv.slot = atoi(optarg); break;
+        case 'r': rate = optarg; break;
+        case 'p': cv.prefix = optarg; break;
+        case 'z': cv.level = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if(argc - optind != (cv.prefix ? 1 : 2) || cv.first < 0 || cv.slot < 0 || cv.slot >= RING_FRAMES)
+        usage();
+    if(threads < 1)
+        threads = 1;
+
+    fd = open(argv[optind], O_RDONLY);
+    if(fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    if((unsigned long)st.st_size < offset + RING_STRIDE)
+    {
+        fprintf(stderr, "ringconv: %s holds no whole frame\n", argv[optind]);
+        return 1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    cv.dump = (const uint8_t *)map + offset;
+    cv.nframes = (st.st_size - offset) / RING_STRIDE;
+    if(cv.first >= cv.nframes)
+    {
+        fprintf(stderr, "ringconv: %s has %ld frames\n", argv[optind], cv.nframes);
+        return 1;
+    }
+    if(cv.count < 0 || cv.count > cv.nframes - cv.first)
+        cv.count = cv.nframes - cv.first;
+    tid = malloc(sizeof(pthread_t) * threads);
+
+    if(cv.prefix)
+    {
+        cv.end = cv.count;
+        start_pass(&cv, tid, threads, png_worker);
+        finish_pass(tid, threads);
+    }
+    else
+    {
+        // Two batches: one being converted while the other is written
+        long batch = (long)threads * BATCH, done;
+        uint8_t *buf[2];
+        FILE *fp = strcmp(argv[optind + 1], "-") ? fopen(argv[optind + 1], "wb") : stdout;
+        int cur = 0, num = 24, den = 1;
+
+        buf[0] = malloc((size_t)batch * Y4M_FRAME);
+        buf[1] = malloc((size_t)batch * Y4M_FRAME);
+        if(!fp || !buf[0] || !buf[1])
+        {
+            perror(argv[optind + 1]);
+            return 1;
+        }
+        if(sscanf(rate, "%d:%d", &num, &den) < 1 || num < 1 || den < 1)
+            usage();
+        fprintf(fp, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420mpeg2 XYSCSS=420MPEG2 XCOLORRANGE=FULL\n",
+                HOST_WIDTH, HOST_HEIGHT, num, den);
+
+        cv.out = buf[cur];
+        cv.end = batch < cv.count ? batch : cv.count;
+        start_pass(&cv, tid, threads, y4m_worker);
+        for(done = 0; done < cv.count; )
+        {
+            long n = cv.end - done;
+
+            finish_pass(tid, threads);
+            if(cv.end < cv.count)
+            {
+                cv.out = buf[cur ^ 1];
+                cv.out_base = cv.next = cv.end;
+                cv.end = cv.end + batch < cv.count ? cv.end + batch : cv.count;
+                start_pass(&cv, tid, threads, y4m_worker);
+            }
+            if(fwrite(buf[cur], Y4M_FRAME, n, fp) != (size_t)n)
+            {
+                perror(argv[optind + 1]);
+                cv.failed = 1;
+                if(cv.end < cv.count)
+                    finish_pass(tid, threads);
+                break;
+            }
+            done += n;
+            cur ^= 1;
+        }
+        if(fp != stdout ? fclose(fp) != 0 : fflush(fp) != 0)
+        {
+            perror(argv[optind + 1]);
+            cv.failed = 1;
+        }
+        free(buf[0]);
+        free(buf[1]);
+    }
+
+    if(!cv.failed)
+        fprintf(stderr, "%s: %ld frames\n", cv.prefix ? cv.prefix : argv[optind + 1], cv.count);
+    free(tid);
+    munmap(map, st.st_size);
+    close(fd);
+    return cv.failed;
+}
@@ -0,0 +1,258 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * tlm2csv [-r] [-w weave.bin] telemetry.bin [out.csv]
+ * tlm2csv -p profile.bin [out.csv]
+ *
+ * Turns the per-frame telemetry calc_histogram appends to its ring at
+ * SCRATCH_TELEMETRY (record layout in memmap.h) into CSV, one line per
+ * frame in record order.  The input is either a sidecar of back-to-back
+ * TLM_RECORD byte records, as a reader draining the ring writes them, or,
+ * with -r or when it starts with the ring's tag, a dump of the ring itself
+ * (from SCRATCH_TELEMETRY), which holds the last TLM_RECORDS records.
+ * Records caught half written (seq TLM_SEQ_BUSY, or not the record number
+ * their slot should hold) are skipped.  Luma
+ * percentiles are in 0-255 levels, the bottom of their 2-level bin.
+ *
+ * The weave columns come from the weave log (SCRATCH_WEAVE_LOG, memmap.h):
+ * the part of a ring dump that follows the records, when the dump is long
+ * enough to hold it, or with -w a sidecar of back-to-back WEAVE_LOG_ENTRY
+ * byte entries drained alongside the records.  weave_dx and weave_dy are
+ * the picture's move since the previous frame in pixels, right and down;
+ * they are empty for records without a log entry, and weave_ok is 0 when
+ * there was no previous frame to match against.
+ *
+ * With -p the input is instead a dump of SCRATCH_PROFILE from a PROFILE=1
+ * build (PROF_HEADER + PROF_ENTRIES x 4 words, memmap.h), written as one
+ * line per entry with the last, min, average and max in CP0 Count ticks.
+ * Entries that never ran are left out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static void print_record(FILE *out, const uint8_t *r, const uint8_t *w)
+{
+    uint8_t flags = r[TLM_FLAGS];
+    const uint8_t *pct = r + TLM_Y_PCT;
+
+    fprintf(out, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%u,%u,%u,%u,%u,%u,%d,%d,%d,%d,%u,",
+            get32(r + TLM_SEQ), get32(r + TLM_FRAMENO), get32(r + TLM_ENC_FRAMES),
+            get16(r + TLM_ISO), get16(r + TLM_EXPO_TIME),
+            get16(r + TLM_WB), get16(r + TLM_WB + 2), get16(r + TLM_WB + 4),
+            r[TLM_QP], (int8_t)r[TLM_EV_BIAS],
+            pct[0]*2, pct[1]*2, pct[2]*2, pct[3]*2, pct[4]*2, r[TLM_Y_MEAN],
+            !!(flags & TLM_F_ENCODE), !!(flags & TLM_F_CORRECTING),
+            !!(flags & TLM_F_SETTLING), !!(flags & TLM_F_EXPO_CHANGED), r[TLM_SLOT]);
+    if(w)
+    {
+        uint32_t conf = get32(w + WEAVE_LOG_CONF);
+        fprintf(out, "%.4f,%.4f,%u,%u,%d\n",
+                (int16_t)get16(w + WEAVE_LOG_DXDY) / 16.0, (int16_t)get16(w + WEAVE_LOG_DXDY + 2) / 16.0,
+                conf & 0xff, (conf >> 8) & 0xff, !!(conf & WEAVE_PUB_OK));
+    }
+    else
+        fprintf(out, ",,,,\n");
+}
+
+static uint8_t *read_file(const char *path, long *size)
+{
+    uint8_t *buf;
+    FILE *fp = fopen(path, "rb");
+
+    if(fp == 0)
+    {
+        perror(path);
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = malloc(*size + 1);
+    if(buf == 0 || fread(buf, 1, *size, fp) != (size_t)*size)
+    {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+    return buf;
+}
+
+static int print_profile(FILE *out, const uint8_t *buf, long size, const char *path)
+{
+    static const char *names[PROF_ENTRIES] = PROF_NAMES;
+    int e;
+
+    if(size < (PROF_HEADER + PROF_ENTRIES * 4) * 4 || get32(buf) != PROF_TAG)
+    {
+        fprintf(stderr, "%s: not a profile dump\n", path);
+        return 1;
+    }
+    fprintf(out, "entry,frameno,last,min,avg,max\n");
+    for(e = 0; e < PROF_ENTRIES; e++)
+    {
+        const uint8_t *p = buf + (PROF_HEADER + e * 4) * 4;
+        if(get32(p + PROF_MAX * 4) == 0)
+            continue;
+        fprintf(out, "%s,%u,%u,%u,%u,%u\n", names[e], get32(buf + 4),
+                get32(p + PROF_LAST * 4), get32(p + PROF_MIN * 4),
+                get32(p + PROF_AVG * 4) >> PROF_AVG_SHIFT, get32(p + PROF_MAX * 4));
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ring = 0, profile = 0, argi = 1;
+    uint8_t *buf, *wbuf = 0, *log = 0;
+    long size, wsize = 0, i, w = 0, skipped = 0;
+    FILE *out = stdout;
+
+    for(; argi < argc && argv[argi][0] == '-'; argi++)
+    {
+        if(strcmp(argv[argi], "-r") == 0)
+            ring = 1;
+        else if(strcmp(argv[argi], "-p") == 0)
+            profile = 1;
+        else if(strcmp(argv[argi], "-w") == 0 && argi + 1 < argc)
+        {
+            wbuf = read_file(argv[++argi], &wsize);
+            if(wbuf == 0)
+                return 1;
+            if(wsize % WEAVE_LOG_ENTRY)
+                fprintf(stderr, "%s: %ld trailing bytes ignored\n", argv[argi], wsize % WEAVE_LOG_ENTRY);
+            wsize /= WEAVE_LOG_ENTRY;
+        }
+        else
+            break;
+    }
+    if(argc - argi < 1 || argc - argi > 2)
+    {
+        fprintf(stderr, "usage: tlm2csv [-r] [-w weave.bin] telemetry.bin [out.csv]\n"
+                        "       tlm2csv -p profile.bin [out.csv]\n");
+        return 1;
+    }
+
+    buf = read_file(argv[argi], &size);
+    if(buf == 0)
+        return 1;
+
+    if(profile)
+    {
+        if(argc - argi == 2 && (out = fopen(argv[argi + 1], "w")) == 0)
+        {
+            perror(argv[argi + 1]);
+            return 1;
+        }
+        if(print_profile(out, buf, size, argv[argi]))
+            return 1;
+        if(out != stdout && fclose(out) != 0)
+        {
+            perror(argv[argi + 1]);
+            return 1;
+        }
+        free(buf);
+        return 0;
+    }
+
+    if(size >= 4 && get32(buf) == TLM_TAG)
+        ring = 1;
+    if(ring && (size < TLM_HEADER + TLM_RECORDS * TLM_RECORD || get32(buf) != TLM_TAG))
+    {
+        fprintf(stderr, "%s: not a telemetry ring dump\n", argv[argi]);
+        return 1;
+    }
+    if(ring && size >= TLM_HEADER + TLM_RECORDS * (TLM_RECORD + WEAVE_LOG_ENTRY))
+        log = buf + TLM_HEADER + TLM_RECORDS * TLM_RECORD;
+    if(!ring && size % TLM_RECORD)
+        fprintf(stderr, "%s: %ld trailing bytes ignored\n", argv[argi], size % TLM_RECORD);
+
+    if(argc - argi == 2)
+    {
+        out = fopen(argv[argi + 1], "w");
+        if(out == 0)
+        {
+            perror(argv[argi + 1]);
+            return 1;
+        }
+    }
+    fprintf(out, "seq,frameno,enc_frames,iso,expo_time,wb_r,wb_g,wb_b,qp,ev_bias,"
+                 "y_p1,y_p10,y_p50,y_p90,y_p99,y_mean,encode,correcting,settling,expo_changed,slot,"
+                 "weave_dx,weave_dy,weave_conf_x,weave_conf_y,weave_ok\n");
+    if(ring)
+    {
+        // The last TLM_RECORDS records before head, slot n % TLM_RECORDS
+        uint32_t head = get32(buf + 4), k = head > TLM_RECORDS ? head - TLM_RECORDS : 0;
+        for(; k != head; k++)
+        {
+            const uint8_t *r = buf + TLM_HEADER + (k % TLM_RECORDS) * TLM_RECORD;
+            const uint8_t *e = log ? log + (k % TLM_RECORDS) * WEAVE_LOG_ENTRY : 0;
+            if(get32(r + TLM_SEQ) != k)
+                skipped++;
+            else
+                print_record(out, r, e && get32(e + WEAVE_LOG_SEQ) == k ? e : 0);
+        }
+    }
+    else
+    {
+        for(i = 0; i < size / TLM_RECORD; i++)
+        {
+            const uint8_t *r = buf + i * TLM_RECORD;
+            uint32_t seq = get32(r + TLM_SEQ);
+            if(seq == TLM_SEQ_BUSY)
+            {
+                skipped++;
+                continue;
+            }
+            // both sidecars are in record order, entries without a record are passed over
+            while(w < wsize && get32(wbuf + w * WEAVE_LOG_ENTRY + WEAVE_LOG_SEQ) < seq)
+                w++;
+            print_record(out, r, w < wsize && get32(wbuf + w * WEAVE_LOG_ENTRY + WEAVE_LOG_SEQ) == seq ?
+                                 wbuf + w * WEAVE_LOG_ENTRY : 0);
+        }
+    }
+    if(skipped)
+        fprintf(stderr, "%s: %ld half written records skipped\n", argv[argi], skipped);
+    if(out != stdout && fclose(out) != 0)
+    {
+        perror(argv[argi + 1]);
+        return 1;
+    }
+    free(buf);
+    free(wbuf);
+    return 0;
+}
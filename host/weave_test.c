@@ -0,0 +1,216 @@
+/*!
+ * Copyright (c) 2025 David A. Newman (a.k.a. 0dan0)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * weave_test [tlm2csv]
+ *
+ * Shows calc_histogram a few frames of a textured picture, each moved by a
+ * known whole number of pixels from the one before, drains the telemetry
+ * ring and the weave log into sidecars as a reader would, writes a dump of
+ * both, and checks that tlm2csv gives every frame's move in its weave
+ * columns, from the sidecars as well as from the dump.  Exits non-zero on
+ * a mismatch.  Run by "make test".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+
+#define TEX_W   (HOST_WIDTH + 64)
+#define TEX_H   (HOST_HEIGHT + 64)
+#define FRAMES  6
+
+// where the camera looked, the picture moves the other way.  The first
+// call only finds the frame ring and the second has no frame to match
+static const int view[FRAMES][2] = { {32, 32}, {32, 32}, {35, 30}, {31, 31}, {31, 36}, {26, 33} };
+
+static uint8_t tex[TEX_H][TEX_W];
+
+// Smoothed noise, -64..64 or so
+static void make_noise(int *a, int n, uint32_t seed)
+{
+    int b[TEX_W], i, k, pass;
+
+    for(i=0; i<n; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        a[i] = ((seed >> 16) & 255) - 128;
+    }
+    for(pass=0; pass<2; pass++)
+    {
+        for(i=0; i<n; i++)
+        {
+            int s = 0, c = 0;
+            for(k=-3; k<=3; k++)
+                if(i+k >= 0 && i+k < n) { s += a[i+k]; c++; }
+            b[i] = s / c;
+        }
+        memcpy(a, b, n * sizeof(*a));
+    }
+    for(i=0; i<n; i++)
+        a[i] *= 2;
+}
+
+// A column pattern plus a row pattern, so a move along one axis leaves the
+// other axis's projection alone and the match is exact to the 1/16 pixel
+static void make_texture(void)
+{
+    int gx[TEX_W], gy[TEX_H], x, y;
+
+    make_noise(gx, TEX_W, 12345);
+    make_noise(gy, TEX_H, 54321);
+    for(y=0; y<TEX_H; y++)
+        for(x=0; x<TEX_W; x++)
+        {
+            int v = 128 + gx[x] + gy[y];
+            tex[y][x] = v < 0 ? 0 : v > 255 ? 255 : v;
+        }
+}
+
+// Copy out records and log entries that read the same seq before and after
+static void drain(FILE *records, FILE *weave, uint32_t *tail)
+{
+    uint32_t *tlm = MM(uint32_t *, SCRATCH_TELEMETRY);
+    uint8_t *log = MM(uint8_t *, SCRATCH_WEAVE_LOG);
+    uint32_t head = tlm[1];
+    uint8_t c[TLM_RECORD];
+
+    if(head - *tail > TLM_RECORDS)
+        *tail = head - TLM_RECORDS;
+    for(; *tail != head; ++*tail)
+    {
+        uint8_t *r = (uint8_t *)tlm + TLM_HEADER + (*tail % TLM_RECORDS) * TLM_RECORD;
+        uint8_t *e = log + (*tail % TLM_RECORDS) * WEAVE_LOG_ENTRY;
+        uint32_t s1 = *(volatile uint32_t *)r;
+        memcpy(c, r, TLM_RECORD);
+        if(s1 == *tail && *(volatile uint32_t *)r == *tail)
+            fwrite(c, 1, TLM_RECORD, records);
+        s1 = *(volatile uint32_t *)e;
+        memcpy(c, e, WEAVE_LOG_ENTRY);
+        if(s1 == *tail && *(volatile uint32_t *)e == *tail)
+            fwrite(c, 1, WEAVE_LOG_ENTRY, weave);
+    }
+    tlm[2] = *tail;
+}
+
+// Run tlm2csv and check the weave columns of each frame, 0 when they match
+static int check(const char *cmd)
+{
+    char line[512];
+    int n = 1, bad = 0;
+    FILE *p = popen(cmd, "r");
+
+    if(p == 0 || fgets(line, sizeof(line), p) == 0)
+    {
+        fprintf(stderr, "%s: no output\n", cmd);
+        return 1;
+    }
+    while(fgets(line, sizeof(line), p))
+    {
+        char *f = line;
+        int col, ok;
+        unsigned frameno;
+        double dx, dy;
+
+        sscanf(f, "%*u,%u", &frameno);
+        for(col = 0; col < 21 && f; col++)
+        {
+            f = strchr(f, ',');
+            if(f) f++;
+        }
+        if(f == 0 || sscanf(f, "%lf,%lf,%*u,%*u,%d", &dx, &dy, &ok) != 3)
+        {
+            fprintf(stderr, "%s: frame %u has no weave columns\n", cmd, frameno);
+            bad++;
+        }
+        else if(n == 1 ? ok : !ok || dx < -0.25 + (view[n-1][0] - view[n][0]) ||
+                                     dx > 0.25 + (view[n-1][0] - view[n][0]) ||
+                                     dy < -0.25 + (view[n-1][1] - view[n][1]) ||
+                                     dy > 0.25 + (view[n-1][1] - view[n][1]))
+        {
+            fprintf(stderr, "%s: frame %u weave %d %.4f,%.4f, expected %d,%d\n", cmd, frameno, ok, dx, dy,
+                    n > 1 ? view[n-1][0] - view[n][0] : 0, n > 1 ? view[n-1][1] - view[n][1] : 0);
+            bad++;
+        }
+        n++;
+    }
+    if(pclose(p) != 0 || n != FRAMES)
+    {
+        fprintf(stderr, "%s: %d of %d frames\n", cmd, n - 1, FRAMES - 1);
+        bad++;
+    }
+    return bad;
+}
+
+int main(int argc, char **argv)
+{
+    const char *tlm2csv = argc > 1 ? argv[1] : "./tlm2csv";
+    uint8_t *frame = malloc(RING_STRIDE);
+    uint32_t tail = 0;
+    FILE *records, *weave, *dump;
+    char cmd[256];
+    int i, x, y, bad;
+
+    if(frame == 0 || reels_host_init(1) != 0)
+        return 1;
+    make_texture();
+    records = fopen("weave_test.tlm", "wb");
+    weave = fopen("weave_test.wv", "wb");
+    if(records == 0 || weave == 0)
+    {
+        perror("weave_test");
+        return 1;
+    }
+    *MM(uint32_t *, SCRATCH_EXPO_CHANGE) = 0xffff0000;  // preview, histogram shown
+    memset(frame, 128, RING_STRIDE);
+    for(i=0; i<FRAMES; i++)
+    {
+        for(y=0; y<HOST_HEIGHT; y++)
+            for(x=0; x<HOST_WIDTH; x++)
+                frame[y*HOST_WIDTH + x] = tex[y + view[i][1]][x + view[i][0]];
+        reels_host_put_frame(ADDR_RING_PREVIEW, i % 6, frame);
+        *MM(int *, ADDR_FRAMENO) = 100 + i;
+        calc_histogram();
+        if(i & 1)
+            drain(records, weave, &tail);
+    }
+    drain(records, weave, &tail);
+    fclose(records);
+    fclose(weave);
+
+    dump = fopen("weave_test.ring", "wb");
+    if(dump == 0 || fwrite(MM(uint8_t *, SCRATCH_TELEMETRY), 1,
+                           TLM_HEADER + TLM_RECORDS * (TLM_RECORD + WEAVE_LOG_ENTRY), dump) == 0)
+    {
+        perror("weave_test.ring");
+        return 1;
+    }
+    fclose(dump);
+
+    snprintf(cmd, sizeof(cmd), "%s -w weave_test.wv weave_test.tlm", tlm2csv);
+    bad = check(cmd);
+    snprintf(cmd, sizeof(cmd), "%s weave_test.ring", tlm2csv);
+    bad += check(cmd);
+    printf("weave_test: %s\n", bad ? "FAILED" : "ok");
+    return bad != 0;
+}
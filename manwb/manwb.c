@@ -21,6 +21,7 @@
  */
  
 #include <stdint.h>
+#include "memmap.h"
 
 enum LEVELS { 
    LVL_P20,
@@ -34,69 +35,26 @@ enum LEVELS {
    LVL_N20,
 };
 
-#define BUTTON_UP    0x1
-#define BUTTON_DOWN  0x2
-#define BUTTON_LEFT  0x4
-#define BUTTON_RIGHT 0x8
-#define BUTTON_BACK  0x20
-#define BUTTON_NEG   0x100
-#define BUTTON_PLUS  0x200
-#define BUTTON_OK    0x800
-
-#define NVM_WBAL        0
-#define NVM_SHARPEN     1
-#define NVM_SAT         2
-#define NVM_FREE        3
-#define NVM_DONOT_USE   4
-#define NVM_WB_MODS     5
-#define NVM_EVBIAS      6
-#define NVM_FPS         7
-#define NVM_QPMIN       8
-#define NVM_ISOMAX      9
-#define NVM_EXPLOCK     10
-
-#define NVM_NAV         13
-#define NVM_ISO_LOCK    14
-#define NVM_SHUT_LOCK   15
-
-#define NVM_SAVE_WBAL    16
-#define NVM_SAVE_SHARPEN 17
-#define NVM_SAVE_SAT     18
-
 
 void select_wb(void)
 {	
-	asm volatile (
-		".word 0x202d2d2d\n" //--- 
-		".word 0x20545543\n" //CUT 
-		".word 0x45524548\n" //HERE
-		".word 0x2d2d2d20\n" //--- 
-	);
+	CUT_HERE();
 	
-	volatile int* reelType = (int *)0x80340000;
-	volatile int* frameno = (int *)0x80f8214c; //frame counter
-	volatile uint32_t *enc_frames = (uint32_t *) 0x85bf0014;
-	int32_t* nvm_base = (uint32_t *)0x80E0B78C; //Type A - exposure, sharpness, tint
-	uint32_t* active_settings = (uint32_t *)0x80DDC11C; // Settings for exposure, sharpness, tint
-    volatile uint32_t* button = (uint32_t *)0xA0E8BFF8; // uncached
-	volatile int* button_read = (int *)0x85bf002c; // my flag to acknowledge the button press.
-    
-    if(*reelType == 2)
-    {
-		nvm_base = (int *)0x80E0B87C; //exposure, sharpness, tint
-        active_settings = (uint32_t *)0x80DDC204;
-        button = (uint32_t *)0xA0E8C0E8;
-    }
-	if(*reelType == 3)
-    {
-		nvm_base = (int *)0x80E0AD0C; //exposure, sharpness, tint
-        active_settings = (uint32_t *)0x80DDB69C;
-        button = (uint32_t *)0xA0E8B578;
-    }
+#if PROFILE
+	uint32_t prof_t0, prof_t1;
+	CP0_COUNT(prof_t0);
+#endif
+	int reelType = REEL_TYPE(); // 1, 2 or 3, a constant in a REEL= build
+	volatile int* frameno = MM(int *, ADDR_FRAMENO); //frame counter
+	volatile uint32_t *enc_frames = MM(uint32_t *, SCRATCH_ENC_FRAMES);
+	int32_t* nvm_base = MM(int32_t *, REEL_ADDR(NVM_BASE, reelType)); //exposure, sharpness, tint
+	uint32_t* active_settings = MM(uint32_t *, REEL_ADDR(ACTIVE_SETTINGS, reelType)); // Settings for exposure, sharpness, tint
+    volatile uint32_t* button = MM(uint32_t *, REEL_ADDR(BUTTON, reelType)); // uncached
+	volatile int* button_read = MM(int *, SCRATCH_BUTTON_READ); // my flag to acknowledge the button press.
     
 	if(*frameno > 25 && *frameno < 3600*24*25) 
 	{
-	    uint32_t r,g,b,*wb_gains = (uint32_t *)0x85bf0020;
+	    uint32_t r,g,b,*wb_gains = MM(uint32_t *, SCRATCH_WB_GAINS);
                 
         uint32_t* whitebal = &nvm_base[NVM_WBAL];
 	    uint32_t* sharpness = &nvm_base[NVM_SHARPEN];
@@ -110,6 +68,8 @@ void select_wb(void)
             nvm_base[NVM_SHUT_LOCK] = 2048;
             nvm_base[NVM_NAV] = 3; //EV  <- This is causing the first boot after flashing, not to run (when NVM_NAV was 4)
             nvm_base[NVM_WB_MODS]=0;    
+            nvm_base[NVM_PROFILE_GAINS] = 0; // whatever the old firmware left there is no profile
+            nvm_base[NVM_PROFILE_BASE] = 0;
             
             if(nvm_base[NVM_SAVE_WBAL] > 0 || nvm_base[NVM_SAVE_SHARPEN] > 0 || nvm_base[NVM_SAVE_SAT] > 0)
             {
@@ -129,6 +89,7 @@ void select_wb(void)
         int sr = (nvm_base[NVM_WB_MODS]<<8) >> 24;
         int sb = (nvm_base[NVM_WB_MODS]<<16) >> 24;
         int sg = (nvm_base[NVM_WB_MODS]<<24) >> 24;
+        int mode = (nvm_base[NVM_WB_MODS] & WB_MODS_MODE) >> WB_MODS_MODE_SHIFT;
         
         r = 0x1D0; g = 0x100; b = 0x100;
 	    if(*whitebal == LVL_P20) { r += 0x80;              }
@@ -140,6 +101,19 @@ void select_wb(void)
 	    if(*whitebal == LVL_N10) { r -= 0x20;  b += 0x40;  }
 	    if(*whitebal == LVL_N15) { r -= 0xA0;  b += 0xc0;  }
 	    if(*whitebal == LVL_N20) { r -= 0xD0;  b += 0xc0;  }
+        
+        // The film base profile replaces the preset, the tint is still added
+        if(mode == WB_MODE_PROFILE && NVM_PROFILE_VALID(nvm_base))
+        {
+            r = nvm_base[NVM_PROFILE_GAINS] & 0xfff; g = 0x100; b = (nvm_base[NVM_PROFILE_GAINS] >> 12) & 0xfff;
+        }
+        
+        // Auto WB replaces the preset, once calc_histogram has an estimate
+        uint32_t *awb_gains = MM(uint32_t *, SCRATCH_AWB);
+        if(mode == WB_MODE_AUTO && awb_gains[0] == AWB_TAG)
+        {
+            r = awb_gains[1]; g = awb_gains[2]; b = awb_gains[3];
+        }
        
        
         if(button[3] >= 2)// button pressed and held ~0.1s
@@ -152,14 +126,25 @@ void select_wb(void)
                 if(button[0] == BUTTON_DOWN || button[0] == BUTTON_RIGHT) 
                     nvm_base[NVM_NAV]++;
                     
-                // 0 wb_mods_r, 1 blue, 2 green, 3 ev, 4 fps, 5 Qp, 6 ExpLock 
+                // 0 wb_mods_r, 1 blue, 2 green, 3 ev, 4 fps, 5 Qp, 6 ExpLock, 8 WB mode
                 if(nvm_base[NVM_NAV] < 0) 
-                    nvm_base[NVM_NAV] = 7;
-                if(nvm_base[NVM_NAV] > 7) 
+                    nvm_base[NVM_NAV] = 8;
+                if(nvm_base[NVM_NAV] > 8) 
                     nvm_base[NVM_NAV] = 0;
                  
                 int addr = nvm_base[NVM_NAV] - 2;
-                if(addr >= 1)
+                if(nvm_base[NVM_NAV] == 8) // WB mode, presets, auto, profile, calibrate, in NVM_WB_MODS
+                {
+                    // modes that are not built in are stepped over.  Capturing
+                    // overwrites the stored profile, so only + from the profile
+                    // gets there; - from the presets wraps to the profile.
+                    if(button[0] == BUTTON_PLUS)
+                        do mode = (mode + 1) & 3; while(!WB_MODE_BUILT(mode));
+                    if(button[0] == BUTTON_NEG)
+                        do mode = mode == WB_MODE_PRESET ? WB_MODE_PROFILE : mode - 1; while(!WB_MODE_BUILT(mode));
+                    nvm_base[NVM_WB_MODS] = (nvm_base[NVM_WB_MODS] & ~WB_MODS_MODE) | mode << WB_MODS_MODE_SHIFT;
+                }
+                else if(addr >= 1)
                 {
                     if(button[0] == BUTTON_PLUS)  //EV Bias
                         nvm_base[NVM_WB_MODS+addr]++;
@@ -191,7 +176,7 @@ void select_wb(void)
                             sb--;
                     }
                     
-                    nvm_base[NVM_WB_MODS] = ((sr << 16) & 0xff0000) | ((sb << 8) & 0xff00) | (sg & 0xff);
+                    nvm_base[NVM_WB_MODS] = (mode << WB_MODS_MODE_SHIFT) | ((sr << 16) & 0xff0000) | ((sb << 8) & 0xff00) | (sg & 0xff);
                 }
             }
         }
@@ -237,13 +222,23 @@ void select_wb(void)
             
         if(nvm_base[NVM_SAVE_SAT] != nvm_base[NVM_SAT])
             nvm_base[NVM_SAVE_SAT] = nvm_base[NVM_SAT]; 
+        
+#if PROFILE
+        // CP0 Count profile, shared with calc_histogram
+        uint32_t *prof = MM(uint32_t *, SCRATCH_PROFILE);
+        PROF_INIT(prof);
+        CP0_COUNT(prof_t1);
+        PROF_UPDATE(prof, PROF_WB, prof_t1 - prof_t0);
+#endif
 	}
 	return;
 }
 
+#ifndef REELS_HARNESS
 int main(void)
 {
     select_wb();
 
     return 0;
 }
+#endif
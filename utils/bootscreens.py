@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+bootscreens.py
+
+Encode the boot screens (BootScreenA/B/C.png) as the JPEGs shown at power
+on, each no larger than the size the firmware reserves for it (default
+20 480 bytes), and the cheapest of them to decode, since the decode sits on
+the startup critical path.
+
+Every image and chroma subsampling is searched in parallel: a binary search
+finds the highest quality that fits for 4:2:0, 4:2:2 and 4:4:4.  All
+encodings are baseline (no progressive) with optimized Huffman tables.  Of
+the candidates at or above --min-quality (if any are) the one with the
+lowest estimated decode time wins, ties going to the higher quality.
+
+The decode estimate is a cycle model of a software baseline decoder:
+entropy decoding per compressed byte, a dequantize + IDCT per 8x8 block
+(chroma subsampling removes blocks), and colour conversion per pixel, with
+a little extra for chroma upsampling.  The constants are rough and only
+rank the candidates; --mhz scales the result to milliseconds.
+
+usage:
+    python3 bootscreens.py [images/BootScreenA.png ...] [-o outdir] [-t 20480]
+                           [--min-quality Q] [-s 420,422,444] [-j jobs]
+"""
+
+import argparse
+import io
+import os
+from concurrent.futures import ProcessPoolExecutor
+
+from PIL import Image
+
+SUBSAMPLING = {"444": 0, "422": 1, "420": 2}    # PIL subsampling codes
+CHROMA_BLOCKS = {"444": 2.0, "422": 1.0, "420": 0.5}  # chroma blocks per luma block
+
+HUFF_CYCLES_PER_BYTE = 64       # ~8 cycles per bit of bitstream
+IDCT_CYCLES_PER_BLOCK = 640     # dequantize + integer IDCT of one 8x8 block
+CONVERT_CYCLES_PER_PIXEL = 12   # YCbCr -> RGB + store
+UPSAMPLE_CYCLES_PER_PIXEL = 4   # extra when chroma is subsampled
+
+DEFAULT_SCREENS = [
+    os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "images", f"BootScreen{t}.png")
+    for t in "ABC"
+]
+
+
+def encode(img: Image.Image, quality: int, subsampling: str) -> bytes:
+    buf = io.BytesIO()
+    img.save(
+        buf,
+        format="JPEG",
+        quality=quality,
+        subsampling=SUBSAMPLING[subsampling],
+        optimize=True,          # tuned Huffman tables, still baseline
+        progressive=False,
+    )
+    return buf.getvalue()
+
+
+def decode_cycles(width: int, height: int, size: int, subsampling: str) -> float:
+    luma_blocks = ((width + 7) // 8) * ((height + 7) // 8)
+    blocks = luma_blocks * (1 + CHROMA_BLOCKS[subsampling])
+    per_pixel = CONVERT_CYCLES_PER_PIXEL + (UPSAMPLE_CYCLES_PER_PIXEL if subsampling != "444" else 0)
+    return size * HUFF_CYCLES_PER_BYTE + blocks * IDCT_CYCLES_PER_BLOCK + width * height * per_pixel
+
+
+def search(path: str, subsampling: str, target_bytes: int):
+    """Highest quality that fits for one image and subsampling: (quality, jpeg) or (None, q=1 jpeg)."""
+    img = Image.open(path)
+    if img.mode != "RGB":
+        img = img.convert("RGB")
+
+    lo, hi = 1, 95
+    best = (None, None)
+    while lo <= hi:
+        mid = (lo + hi) // 2
+        data = encode(img, mid, subsampling)
+        if len(data) <= target_bytes:
+            best = (mid, data)
+            lo = mid + 1
+        else:
+            hi = mid - 1
+    if best[1] is None:
+        best = (None, encode(img, 1, subsampling))
+    return path, subsampling, img.size, best[0], best[1]
+
+
+def is_baseline(data: bytes) -> bool:
+    """True if the frame header is SOF0 (baseline DCT, Huffman)."""
+    i = 2
+    while i + 4 <= len(data) and data[i] == 0xFF:
+        marker = data[i + 1]
+        if 0xC0 <= marker <= 0xCF and marker not in (0xC4, 0xC8, 0xCC):
+            return marker == 0xC0
+        i += 2 + int.from_bytes(data[i + 2:i + 4], "big")
+    return False
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(
+        description="Encode boot screens to size-limited JPEGs that decode fastest."
+    )
+    parser.add_argument("inputs", nargs="*", default=DEFAULT_SCREENS, help="Source PNGs (default: images/BootScreen[ABC].png)")
+    parser.add_argument("-o", "--outdir", help="Output directory (default: next to each PNG)")
+    parser.add_argument("-t", "--target", type=int, default=20480, help="Size limit in bytes (default 20480)")
+    parser.add_argument("--min-quality", type=int, default=1, help="Lowest quality worth trading for decode speed (default 1)")
+    parser.add_argument("-s", "--subsampling", default="420,422,444", help="Subsamplings to try (default 420,422,444)")
+    parser.add_argument("--mhz", type=float, default=480.0, help="CPU clock for the decode estimate (default 480)")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="Parallel encoders (default: all cores)")
+    args = parser.parse_args()
+
+    subsamplings = [s.strip().replace(":", "") for s in args.subsampling.split(",")]
+    for s in subsamplings:
+        if s not in SUBSAMPLING:
+            parser.error(f"unknown subsampling {s}, use 420, 422 or 444")
+
+    with ProcessPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        jobs = [pool.submit(search, path, s, args.target) for path in args.inputs for s in subsamplings]
+        results = [job.result() for job in jobs]
+
+    failed = False
+    for path in args.inputs:
+        candidates = []
+        for rpath, s, (w, h), quality, data in results:
+            if rpath != path:
+                continue
+            ms = decode_cycles(w, h, len(data), s) / (args.mhz * 1000.0)
+            candidates.append((s, quality, data, ms))
+            size = (w, h)
+
+        fits = [c for c in candidates if c[1] is not None]
+        good = [c for c in fits if c[1] >= args.min_quality] or fits
+        if good:
+            chosen = min(good, key=lambda c: (c[3], -c[1]))
+        else:
+            chosen = min(candidates, key=lambda c: len(c[2]))
+            failed = True
+
+        print(f"{os.path.basename(path)}  {size[0]}x{size[1]}")
+        for c in candidates:
+            q = f"q={c[1]:2d}" if c[1] is not None else "q= 1 (over)"
+            mark = "  <-" if c is chosen else ""
+            print(f"  {c[0][0]}:{c[0][1]}:{c[0][2]}  {q:11s} {len(c[2]):6d} bytes  ~{c[3]:5.1f} ms{mark}")
+        if not is_baseline(chosen[2]):
+            print("  not a baseline JPEG")
+            failed = True
+        if chosen[1] is None:
+            print(f"  could not reach {args.target} bytes, writing the smallest")
+
+        out_dir = args.outdir or os.path.dirname(path)
+        out_path = os.path.join(out_dir, os.path.splitext(os.path.basename(path))[0] + ".jpg")
+        with open(out_path, "wb") as f:
+            f.write(chosen[2])
+        print(f"  -> {out_path}")
+
+    if failed:
+        raise SystemExit(1)
+
+
+if __name__ == "__main__":
+    main()
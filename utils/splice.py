@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+"""
+splice.py
+
+Splice the compiled hooks into an uncompressed firmware image (.rbn).
+
+Each hook binary (hist.bin, manwb.bin, or the REEL= variants) is the ELF the
+hook makefiles link.  The code that goes into the firmware is everything
+after the four "--- CUT HERE ---" marker words CUT_HERE() emits, up to the
+end of the function that contains them.  The function name picks the stub
+to patch from a stubs file, one line per stub:
+
+    # name           offset      size     [vaddr]
+    calc_histogram   0x0012a400  0x1400   0x8012a400
+    select_wb        0x00131000  0x800
+
+offset and size are file offsets in the .rbn.  When the stub's load address
+(vaddr) is given, absolute j/jal targets inside the hook are moved from the
+link address to it; without it such jumps are reported as errors.
+
+Nothing but the spliced code goes into the firmware, so a hook that takes
+the address of .rodata, .data or .bss (lui/addiu %hi/%lo, gp relative, a
+constant pool) would point into the wrong image.  The hook makefiles link
+with -Wl,-q to keep the relocations, and any relocation in the spliced code
+against something outside it is an error.  An ELF without relocations is
+refused if it has data sections at all.
+
+usage:
+    python3 splice.py FWDV280.rbn hist/hist.bin manwb/manwb.bin [-s FWDV280.stubs] [-o out.rbn]
+    python3 splice.py FWDV280.rbn calc_histogram=hist.raw   (raw binary, stub named)
+"""
+
+import argparse
+import struct
+import sys
+
+CUT_HERE = struct.pack("<4I", 0x202d2d2d, 0x20545543, 0x45524548, 0x2d2d2d20)
+NOP = b"\0\0\0\0"
+
+SHT_SYMTAB, SHT_RELA, SHT_REL, SHF_ALLOC, SHF_EXECINSTR, ET_REL = 2, 4, 9, 2, 4, 1
+R_MIPS = {2: "R_MIPS_32", 4: "R_MIPS_26", 5: "R_MIPS_HI16", 6: "R_MIPS_LO16", 7: "R_MIPS_GPREL16",
+          9: "R_MIPS_GOT16", 10: "R_MIPS_PC16", 11: "R_MIPS_CALL16"}
+R_MIPS_26, R_MIPS_PC16 = 4, 10
+
+
+class SpliceError(Exception):
+    pass
+
+
+def read_stubs(path):
+    stubs = {}
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].split()
+            if not line:
+                continue
+            if len(line) not in (3, 4):
+                raise SpliceError(f"{path}:{n}: expected: name offset size [vaddr]")
+            name, offset, size = line[0], int(line[1], 0), int(line[2], 0)
+            vaddr = int(line[3], 0) if len(line) == 4 else None
+            if offset & 3 or size & 3:
+                raise SpliceError(f"{path}:{n}: {name} is not word aligned")
+            stubs[name] = (offset, size, vaddr)
+    return stubs
+
+
+def cstr(data, at):
+    return data[at:data.index(b"\0", at)].decode()
+
+
+def elf_sections(data):
+    """[(name, sh_name, type, flags, addr, offset, size, link, info, align, entsize)] of a 32-bit LE ELF."""
+    if data[:4] != b"\x7fELF":
+        return None
+    if data[4] != 1 or data[5] != 1:
+        raise SpliceError("not a 32-bit little-endian ELF")
+    shoff, = struct.unpack_from("<I", data, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2e)
+    sections = [struct.unpack_from("<10I", data, shoff + i * shentsize) for i in range(shnum)]
+    names = sections[shstrndx][4] if shstrndx < shnum else None
+    return [(cstr(data, names + sh[0]) if names is not None else "",) + sh for sh in sections]
+
+
+def elf_symbols(data, sections, symtab):
+    """[(name, value, size, info, shndx)] of one symbol table."""
+    sh = sections[symtab]
+    strtab = sections[sh[7]][5]
+    syms = []
+    for i in range(sh[6] // 16):
+        st_name, value, size, info, other, shndx = struct.unpack_from("<IIIBBH", data, sh[5] + i * 16)
+        syms.append((cstr(data, strtab + st_name), value, size, info, shndx))
+    return syms
+
+
+def elf_functions(data, sections):
+    """(name, addr, file offset, size, section) of every function symbol."""
+    funcs = []
+    for n, sh in enumerate(sections):
+        if sh[2] != SHT_SYMTAB:
+            continue
+        for name, value, size, info, shndx in elf_symbols(data, sections, n):
+            if info & 0xf != 2 or shndx == 0 or shndx >= len(sections):  # STT_FUNC, defined
+                continue
+            sec = sections[shndx]
+            funcs.append((name, value, sec[5] + value - sec[4], size, shndx))
+    return funcs
+
+
+def check_references(path, data, sections, text, start, end):
+    """Fail on anything in the code at file offsets start..end that the splice can't carry along."""
+    rel_type = struct.unpack_from("<H", data, 0x10)[0]
+    sec = sections[text]
+    relocs = [n for n, sh in enumerate(sections) if sh[2] in (SHT_REL, SHT_RELA) and sh[8] == text]
+
+    if not relocs:
+        data_secs = [sh[0] for sh in sections
+                     if sh[3] & SHF_ALLOC and not sh[3] & SHF_EXECINSTR and sh[6] > 0 and
+                     sh[0].startswith((".rodata", ".data", ".sdata", ".sbss", ".bss", ".lit", ".got"))]
+        if data_secs:
+            raise SpliceError(f"{path}: has {', '.join(data_secs)} and no relocations to show the hook "
+                              "doesn't use them, link with -Wl,-q")
+        return
+
+    for n in relocs:
+        sh = sections[n]
+        syms = elf_symbols(data, sections, sh[7])
+        size = 12 if sh[2] == SHT_RELA else 8
+        for i in range(sh[6] // size):
+            r_offset, r_info = struct.unpack_from("<II", data, sh[5] + i * size)
+            at = sec[5] + r_offset - sec[4]  # r_offset is an address, 0 based in an object
+            if not start <= at < end:
+                continue
+            kind, (name, value, _, info, shndx) = r_info & 0xff, syms[r_info >> 8]
+            inside = shndx == text
+            if inside and kind == R_MIPS_26 and rel_type == ET_REL:
+                raise SpliceError(f"{path}: jump at +0x{at - start:x} of an unlinked object, splice the linked hook")
+            if inside and kind in (R_MIPS_PC16, R_MIPS_26):
+                continue  # branches, and jumps relocate() moves
+            target = sections[shndx][0] if 0 < shndx < len(sections) else "undefined" if shndx == 0 else "common"
+            what = f"{name} in {target}" if name else target
+            raise SpliceError(f"{path}: {R_MIPS.get(kind, f'relocation type {kind}')} at +0x{at - start:x} "
+                              f"refers to {what}, which is not spliced with the hook")
+
+
+def extract_hook(path):
+    """(function name, link address of the first spliced word, code) of one hook binary."""
+    data = open(path, "rb").read()
+    at = data.find(CUT_HERE)
+    if at < 0 or at & 3:
+        raise SpliceError(f"{path}: no CUT HERE marker")
+    if data.find(CUT_HERE, at + 1) >= 0:
+        raise SpliceError(f"{path}: more than one CUT HERE marker")
+
+    sections = elf_sections(data)
+    if sections is None:  # raw binary, the hook runs to the end of the file
+        print(f"splice: warning: {path} is a raw binary, its data references can't be checked", file=sys.stderr)
+        return None, None, data[at + len(CUT_HERE):]
+    for name, addr, off, size, text in elf_functions(data, sections):
+        if off <= at < off + size:
+            start = at + len(CUT_HERE)
+            check_references(path, data, sections, text, start, off + size)
+            return name, addr + start - off, data[start:off + size]
+    raise SpliceError(f"{path}: marker is not inside a function")
+
+
+def relocate(name, code, link, vaddr):
+    """Move absolute j/jal targets within the hook from link to vaddr."""
+    out = bytearray(code)
+    end = link + len(code)
+    for i in range(0, len(code) & ~3, 4):
+        word, = struct.unpack_from("<I", code, i)
+        op = word >> 26
+        if op not in (2, 3):  # j, jal
+            continue
+        pc = link + i
+        target = ((pc + 4) & 0xf0000000) | ((word & 0x03ffffff) << 2)
+        if not link <= target < end:
+            raise SpliceError(f"{name}: {'jal' if op == 3 else 'j'} at +0x{i:x} leaves the hook (0x{target:08x})")
+        if vaddr is None:
+            raise SpliceError(f"{name}: absolute jump at +0x{i:x}, the stub needs its vaddr")
+        moved = target - link + vaddr
+        if (moved ^ (vaddr + i + 4)) & 0xf0000000:
+            raise SpliceError(f"{name}: jump at +0x{i:x} can't reach 0x{moved:08x}")
+        struct.pack_into("<I", out, i, (op << 26) | ((moved >> 2) & 0x03ffffff))
+    return bytes(out)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Splice hook binaries into a firmware image at their stubs.")
+    ap.add_argument("rbn", help="uncompressed firmware image")
+    ap.add_argument("hooks", nargs="+", help="hook binaries (hist.bin, manwb.bin, ...)")
+    ap.add_argument("-s", "--stubs", help="stub table, default <rbn without .rbn>.stubs")
+    ap.add_argument("-o", "--out", help="output image, default patch the .rbn in place")
+    ap.add_argument("-n", "--dry-run", action="store_true", help="check and report only")
+    args = ap.parse_args()
+
+    stubs_path = args.stubs or (args.rbn[:-4] if args.rbn.lower().endswith(".rbn") else args.rbn) + ".stubs"
+    try:
+        stubs = read_stubs(stubs_path)
+        image = bytearray(open(args.rbn, "rb").read())
+
+        for path in args.hooks:
+            want, _, path = path.rpartition("=")
+            name, link, code = extract_hook(path)
+            if want:
+                if name is not None and name != want:
+                    raise SpliceError(f"{path}: marker is in {name}, not {want}")
+                name, link = want, link if name is not None else 0
+            if name is None:
+                raise SpliceError(f"{path}: not an ELF, name the stub: <name>={path}")
+            if name not in stubs:
+                raise SpliceError(f"{path}: no stub for {name} in {stubs_path}")
+            offset, size, vaddr = stubs[name]
+            if offset + size > len(image):
+                raise SpliceError(f"{name}: stub 0x{offset:x}+0x{size:x} is past the end of {args.rbn}")
+            code = relocate(name, code, link, vaddr)
+            if len(code) > size:
+                raise SpliceError(f"{name}: {len(code)} bytes don't fit the {size} byte stub at 0x{offset:x}, "
+                                  f"{len(code) - size} over")
+            image[offset:offset + size] = (code + NOP * (size // 4))[:size]
+            print(f"{name:16s} {len(code):6d} bytes at 0x{offset:08x}, {size - len(code):6d} of {size} left")
+    except (OSError, SpliceError) as e:
+        print(f"splice: {e}", file=sys.stderr)
+        sys.exit(1)
+
+    if not args.dry_run:
+        with open(args.out or args.rbn, "wb") as f:
+            f.write(image)
+
+
+if __name__ == "__main__":
+    main()